@@ -0,0 +1,225 @@
+/*
+================================
+Sprite Sheet
+================================
+*/
+
+// Frames are numbered row by row from the top-left of the texture.
+global void InitSpriteSheet(sprite_sheet* Sheet, texture* Texture, s32 FrameWidth, s32 FrameHeight)
+{
+    s32 Columns = Texture->Width / FrameWidth;
+    s32 Rows = Texture->Height / FrameHeight;
+    f32 InvWidth = 1.0f / Texture->Width;
+    f32 InvHeight = 1.0f / Texture->Height;
+
+    *Sheet = {};
+    Sheet->Texture = Texture;
+    Sheet->FrameWidth = FrameWidth;
+    Sheet->FrameHeight = FrameHeight;
+    Sheet->FrameCount = Columns * Rows;
+    Sheet->Frames = (sprite_frame*)malloc(sizeof(sprite_frame) * Sheet->FrameCount);
+
+    for (s32 Row = 0; Row < Rows; Row++)
+    {
+        for (s32 Column = 0; Column < Columns; Column++)
+        {
+            sprite_frame* Frame = Sheet->Frames + Row * Columns + Column;
+            Frame->U0 = Column * FrameWidth * InvWidth;
+            Frame->V0 = Row * FrameHeight * InvHeight;
+            Frame->U1 = (Column + 1) * FrameWidth * InvWidth;
+            Frame->V1 = (Row + 1) * FrameHeight * InvHeight;
+        }
+    }
+}
+
+global void FreeSpriteSheet(sprite_sheet* Sheet)
+{
+    free(Sheet->Frames);
+    *Sheet = {};
+}
+
+// Returns the clip's index, or -1 when the sheet already has
+// SPRITE_SHEET_MAX_CLIPS clips or the frames are outside the sheet.
+global s32 AddAnimationClip(sprite_sheet* Sheet, u32 FirstFrame, u32 FrameCount, f32 FramesPerSecond, bool Loop)
+{
+    if (Sheet->ClipCount == SPRITE_SHEET_MAX_CLIPS) return -1;
+    if (!FrameCount || FirstFrame + FrameCount > Sheet->FrameCount) return -1;
+
+    animation_clip* Clip = Sheet->Clips + Sheet->ClipCount;
+    Clip->FirstFrame = FirstFrame;
+    Clip->FrameCount = FrameCount;
+    Clip->FramesPerSecond = FramesPerSecond;
+    Clip->Loop = Loop;
+    return (s32)Sheet->ClipCount++;
+}
+
+/*
+================================
+Animators
+================================
+*/
+
+global void InitAnimatorSet(animator_set* Set, sprite_sheet* Sheet, u32 Capacity)
+{
+    Capacity = (Capacity + ANIMATION_LANES - 1) & ~(ANIMATION_LANES - 1);
+
+    *Set = {};
+    Set->Sheet = Sheet;
+    Set->Capacity = Capacity;
+    Set->Time = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    Set->Rate = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    Set->Length = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    Set->LoopMask = (u32*)_mm_malloc(sizeof(u32) * Capacity, 16);
+    Set->FirstFrame = (s32*)_mm_malloc(sizeof(s32) * Capacity, 16);
+    Set->Frame = (s32*)_mm_malloc(sizeof(s32) * Capacity, 16);
+    Set->PositionX = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    Set->PositionY = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    Set->Colors = (color*)_mm_malloc(sizeof(color) * Capacity, 16);
+
+    // Unused lanes hold frame 0 and never advance
+    for (u32 i = 0; i < Capacity; i++)
+    {
+        Set->Time[i] = 0.0f;
+        Set->Rate[i] = 0.0f;
+        Set->Length[i] = 1.0f;
+        Set->LoopMask[i] = 0;
+        Set->FirstFrame[i] = 0;
+        Set->Frame[i] = 0;
+    }
+}
+
+global void FreeAnimatorSet(animator_set* Set)
+{
+    _mm_free(Set->Time);
+    _mm_free(Set->Rate);
+    _mm_free(Set->Length);
+    _mm_free(Set->LoopMask);
+    _mm_free(Set->FirstFrame);
+    _mm_free(Set->Frame);
+    _mm_free(Set->PositionX);
+    _mm_free(Set->PositionY);
+    _mm_free(Set->Colors);
+    *Set = {};
+}
+
+// Restarts animator Index on Clip. Speed scales the clip's frame rate.
+global void PlayClip(animator_set* Set, u32 Index, s32 Clip, f32 Speed = 1.0f)
+{
+    const animation_clip& Source = Set->Sheet->Clips[Clip];
+    Set->Time[Index] = 0.0f;
+    Set->Rate[Index] = Source.FramesPerSecond * glm::max(Speed, 0.0f);
+    Set->Length[Index] = (f32)Source.FrameCount;
+    Set->LoopMask[Index] = Source.Loop ? 0xFFFFFFFFu : 0;
+    Set->FirstFrame[Index] = (s32)Source.FirstFrame;
+    Set->Frame[Index] = (s32)Source.FirstFrame;
+}
+
+// Returns the new animator's index, or -1 when the set is full.
+global s32 AddAnimator(animator_set* Set, s32 Clip, f32 X, f32 Y, color Color)
+{
+    if (Set->Count == Set->Capacity) return -1;
+
+    u32 Index = Set->Count++;
+    Set->PositionX[Index] = X;
+    Set->PositionY[Index] = Y;
+    Set->Colors[Index] = Color;
+    PlayClip(Set, Index, Clip);
+    return (s32)Index;
+}
+
+struct animator_job
+{
+    animator_set* Set;
+    f32 DeltaTime;
+};
+
+// Four animators per iteration with no branches: looping lanes wrap their
+// time, the others stop just before the end of the clip. Time never goes
+// negative, so truncating is flooring. Start and End are lane groups.
+internal void UpdateAnimatorsJob(void* Data, u32 Start, u32 End)
+{
+    animator_job* Job = (animator_job*)Data;
+    animator_set* Set = Job->Set;
+
+    __m128 DeltaTime = _mm_set1_ps(Job->DeltaTime);
+    __m128 Half = _mm_set1_ps(0.5f);
+
+    for (u32 Group = Start; Group < End; Group++)
+    {
+        u32 i = Group * ANIMATION_LANES;
+
+        __m128 Time = _mm_load_ps(Set->Time + i);
+        __m128 Length = _mm_load_ps(Set->Length + i);
+        __m128 Loop = _mm_castsi128_ps(_mm_load_si128((const __m128i*)(Set->LoopMask + i)));
+
+        Time = _mm_add_ps(Time, _mm_mul_ps(_mm_load_ps(Set->Rate + i), DeltaTime));
+
+        __m128 Laps = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(Time, Length)));
+        __m128 Wrapped = _mm_sub_ps(Time, _mm_mul_ps(Laps, Length));
+        __m128 Held = _mm_min_ps(Time, _mm_sub_ps(Length, Half));
+        Time = _mm_or_ps(_mm_and_ps(Loop, Wrapped), _mm_andnot_ps(Loop, Held));
+
+        __m128i Frame = _mm_add_epi32(_mm_load_si128((const __m128i*)(Set->FirstFrame + i)), _mm_cvttps_epi32(Time));
+
+        _mm_store_ps(Set->Time + i, Time);
+        _mm_store_si128((__m128i*)(Set->Frame + i), Frame);
+    }
+}
+
+// Advances every animator by DeltaTime and stores the sprite frame
+// DrawAnimators will show. Jobs spreads the lane groups over its threads;
+// pass 0 to step the set on the calling thread.
+global void UpdateAnimators(animator_set* Set, f32 DeltaTime, job_system* Jobs)
+{
+    animator_job Job = {};
+    Job.Set = Set;
+    Job.DeltaTime = DeltaTime;
+
+    u32 GroupCount = (Set->Count + ANIMATION_LANES - 1) / ANIMATION_LANES;
+
+    if (Jobs)
+    {
+        ParallelFor(Jobs, GroupCount, UpdateAnimatorsJob, &Job, Jobs->ChunkSize / ANIMATION_LANES);
+    }
+    else
+    {
+        UpdateAnimatorsJob(&Job, 0, GroupCount);
+    }
+}
+
+struct animator_sprite_source
+{
+    const animator_set* Set;
+    f32 HalfWidth;
+    f32 HalfHeight;
+
+    static void Read(const animator_sprite_source* Source, u32 Index, sprite_quad* Quad)
+    {
+        const animator_set* Set = Source->Set;
+        const sprite_frame& Frame = Set->Sheet->Frames[Set->Frame[Index]];
+
+        f32 X = Set->PositionX[Index];
+        f32 Y = Set->PositionY[Index];
+        Quad->X0 = X - Source->HalfWidth;
+        Quad->Y0 = Y - Source->HalfHeight;
+        Quad->X1 = X + Source->HalfWidth;
+        Quad->Y1 = Y + Source->HalfHeight;
+        Quad->U0 = Frame.U0;
+        Quad->V0 = Frame.V0;
+        Quad->U1 = Frame.U1;
+        Quad->V1 = Frame.V1;
+        Quad->Color = Set->Colors[Index];
+    }
+};
+
+// Draws every animator's current frame centered on its position, Scale
+// times the frame size, straight into the textured batch.
+global void DrawAnimators(const animator_set* Set, f32 Scale = 1.0f)
+{
+    animator_sprite_source Source = {};
+    Source.Set = Set;
+    Source.HalfWidth = Set->Sheet->FrameWidth * Scale * 0.5f;
+    Source.HalfHeight = Set->Sheet->FrameHeight * Scale * 0.5f;
+
+    DrawSprites(Set->Sheet->Texture->Handle, &Source, Set->Count);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#define ANIMATION_LANES 4
+#define SPRITE_SHEET_MAX_CLIPS 32
+
+// Texture coordinates of one frame, computed when the sheet is created so
+// drawing never divides by the texture size.
+struct sprite_frame
+{
+    f32 U0;
+    f32 V0;
+    f32 U1;
+    f32 V1;
+};
+
+// FrameCount consecutive frames of the sheet played at FramesPerSecond.
+// A clip that does not loop holds its last frame.
+struct animation_clip
+{
+    u32 FirstFrame;
+    u32 FrameCount;
+    f32 FramesPerSecond;
+    bool Loop;
+};
+
+// Equally sized frames laid out row by row over a texture.
+struct sprite_sheet
+{
+    texture* Texture;
+    s32 FrameWidth;
+    s32 FrameHeight;
+    u32 FrameCount;
+    sprite_frame* Frames;
+    animation_clip Clips[SPRITE_SHEET_MAX_CLIPS];
+    u32 ClipCount;
+};
+
+// Structure-of-arrays playback state for many sprites of one sheet.
+// PlayClip copies what the update needs out of the clip, so the update
+// reads no clip table. Time is in frames since the clip started, and
+// LoopMask is all ones for looping clips. Arrays are 16-byte aligned and
+// padded to a multiple of ANIMATION_LANES.
+struct animator_set
+{
+    sprite_sheet* Sheet;
+    u32 Count;
+    u32 Capacity;
+    f32* Time;
+    f32* Rate;
+    f32* Length;
+    u32* LoopMask;
+    s32* FirstFrame;
+    s32* Frame;
+    f32* PositionX;
+    f32* PositionY;
+    color* Colors;
+};
@@ -0,0 +1,502 @@
+/*
+================================
+Benchmarks
+================================
+*/
+
+// Benchmarks record into a render_context, so they only measure the CPU
+// side and run without a window or GL context. The fill benchmark is the
+// exception: it times the GPU and runs after InitRenderer.
+
+internal void RunJobScalingBenchmark(u32 PointCount, u32 ChunkSize)
+{
+    vec2* Positions = (vec2*)malloc(sizeof(vec2) * PointCount);
+    color* Colors = (color*)malloc(sizeof(color) * PointCount);
+
+    for (u32 i = 0; i < PointCount; i++)
+    {
+        Positions[i] = vec2(rand() % 1280, rand() % 720);
+        Colors[i] = color{ (u8)rand(), (u8)rand(), (u8)rand(), 255 };
+    }
+
+    render_context* Context = CreateRenderContext(0);
+    u32 MaxThreads = glm::max(std::thread::hardware_concurrency(), 1u);
+    s32 Iterations = 10;
+    f64 SingleThreadTime = 0;
+
+    printf("DrawPoints, %u points, chunk %u\n", PointCount, ChunkSize ? ChunkSize : JOB_DEFAULT_CHUNK_SIZE);
+    printf("threads      ms   Mpts/s  speedup\n");
+
+    for (u32 ThreadCount = 1; ThreadCount <= MaxThreads; ThreadCount++)
+    {
+        InitJobSystem(&JobSystem, ThreadCount, ChunkSize);
+        BeginRenderContext(Context);
+
+        // Warm up so the context storage is grown before timing
+        DrawPoints(Positions, Colors, PointCount);
+        ResetRenderContext(Context);
+
+        f64 Start = GetWallClock();
+        for (s32 Iteration = 0; Iteration < Iterations; Iteration++)
+        {
+            DrawPoints(Positions, Colors, PointCount);
+            ResetRenderContext(Context);
+        }
+        f64 Elapsed = (GetWallClock() - Start) / Iterations;
+
+        EndRenderContext();
+        ShutdownJobSystem(&JobSystem);
+
+        if (ThreadCount == 1) SingleThreadTime = Elapsed;
+        printf("%7u %7.2f %8.1f %8.2f\n", ThreadCount, Elapsed * 1000.0,
+            PointCount / Elapsed / 1e6, SingleThreadTime / Elapsed);
+    }
+
+    FreeRenderContext(Context);
+    free(Positions);
+    free(Colors);
+}
+
+// The world grows with the agent count so the density, and with it the
+// number of neighbors each query visits, stays the same for every row.
+internal void RunSpatialHashBenchmark(f32 Density, f32 Radius)
+{
+    u32 AgentCounts[] = { 10000, 50000, 100000, 250000, 500000, 1000000 };
+    s32 Iterations = 10;
+
+    printf("Spatial hash, %.0f agents per unit^2, radius %.2f, %u threads\n", Density, Radius, JobSystem.ThreadCount);
+    printf("  agents  build ms  query ms  ns/agent\n");
+
+    for (u32 CountIndex = 0; CountIndex < sizeof(AgentCounts) / sizeof(AgentCounts[0]); CountIndex++)
+    {
+        u32 Count = AgentCounts[CountIndex];
+        f32 WorldSize = sqrtf(Count / Density);
+
+        particle_system Particles;
+        InitParticleSystem(&Particles, Count, WorldSize, WorldSize);
+
+        spatial_hash Hash;
+        InitSpatialHash(&Hash, WorldSize, WorldSize, Radius, Count);
+
+        f64 BuildTime = 0;
+        f64 QueryTime = 0;
+
+        for (s32 Iteration = 0; Iteration < Iterations; Iteration++)
+        {
+            f64 Start = GetWallClock();
+            BuildSpatialHash(&Hash, Particles.PositionX, Particles.PositionY, Count, &JobSystem);
+            f64 Built = GetWallClock();
+            SeparateParticles(&Particles, &Hash, Radius, 0.5f, &JobSystem);
+            f64 Queried = GetWallClock();
+
+            BuildTime += Built - Start;
+            QueryTime += Queried - Built;
+        }
+
+        BuildTime /= Iterations;
+        QueryTime /= Iterations;
+        printf("%8u %9.3f %9.3f %9.1f\n", Count, BuildTime * 1000.0, QueryTime * 1000.0,
+            (BuildTime + QueryTime) / Count * 1e9);
+
+        FreeSpatialHash(&Hash);
+        FreeParticleSystem(&Particles);
+    }
+}
+
+// Concave star with Count points, alternating between two radii.
+internal void MakeStarPolygon(vec2* Points, u32 Count, vec2 Center, f32 Radius)
+{
+    for (u32 i = 0; i < Count; i++)
+    {
+        f32 Angle = 6.2831853f * i / Count;
+        f32 R = (i & 1) ? Radius * 0.5f : Radius;
+        Points[i] = Center + vec2(cosf(Angle), sinf(Angle)) * R;
+    }
+}
+
+// A static dashboard chart: panel, grid, axes and eight series. It never
+// changes, so it is what a cached layer is for.
+internal void DrawChartBackground(const rect& Bounds)
+{
+    const u32 SeriesCount = 8;
+    const u32 PointsPerSeries = 256;
+    vec2 Points[SeriesCount * PointsPerSeries];
+    u32 Counts[SeriesCount];
+    color Colors[SeriesCount];
+
+    DrawRect(Bounds.X, Bounds.Y, Bounds.Width, Bounds.Height, color{ 24, 28, 36, 255 });
+
+    for (s32 X = Bounds.X; X < Bounds.X + Bounds.Width; X += 20)
+    {
+        DrawLine(X, Bounds.Y, X, Bounds.Y + Bounds.Height, color{ 48, 54, 66, 255 });
+    }
+    for (s32 Y = Bounds.Y; Y < Bounds.Y + Bounds.Height; Y += 20)
+    {
+        DrawLine(Bounds.X, Y, Bounds.X + Bounds.Width, Y, color{ 48, 54, 66, 255 });
+    }
+
+    for (u32 Series = 0; Series < SeriesCount; Series++)
+    {
+        for (u32 i = 0; i < PointsPerSeries; i++)
+        {
+            f32 T = (f32)i / (PointsPerSeries - 1);
+            f32 Wave = sinf(T * 12.0f + Series * 0.8f) * 0.4f + sinf(T * 31.0f * (Series + 1)) * 0.05f;
+            Points[Series * PointsPerSeries + i] = vec2(Bounds.X + T * Bounds.Width,
+                Bounds.Y + Bounds.Height * (0.5f - Wave));
+        }
+        Counts[Series] = PointsPerSeries;
+        Colors[Series] = color{ (u8)(80 + Series * 20), (u8)(200 - Series * 15), 220, 255 };
+    }
+    DrawPolylines(Points, Counts, Colors, SeriesCount);
+
+    f32 Left = (f32)Bounds.X;
+    f32 Bottom = (f32)(Bounds.Y + Bounds.Height);
+    DrawThickLine(Left, (f32)Bounds.Y, Left, Bottom, 2.0f, COLOR_WHITE);
+    DrawThickLine(Left, Bottom, (f32)(Bounds.X + Bounds.Width), Bottom, 2.0f, COLOR_WHITE);
+}
+
+// A list scrolled by Scroll pixels inside a nine-slice frame. Rows that
+// cross the clip edge exercise every clipping path: sprites, the frame's
+// own grid and upright text are cut down on the CPU, while circles, rounded
+// bars and rotated text fall back to the scissor. Font may be 0.
+internal void DrawScrollingPanel(const rect& Bounds, f32 Scroll, texture* Texture, font* Font)
+{
+    const s32 RowHeight = 40;
+    const s32 RowCount = 32;
+
+    borders Borders = { Texture->Width / 8, Texture->Height / 8, Texture->Width / 8, Texture->Height / 8 };
+    DrawNineSlice(Texture, rect{ 0, 0, Texture->Width, Texture->Height }, Borders, Bounds, color{ 90, 100, 130, 255 });
+
+    rect Content = { Bounds.X + 12, Bounds.Y + 12, Bounds.Width - 24, Bounds.Height - 24 };
+    PushClipRect(Content);
+
+    s32 ContentHeight = RowHeight * RowCount;
+    s32 Offset = (s32)fmodf(Scroll, (f32)ContentHeight);
+    rect SrcRect = { 0, 0, Texture->Width / 2, Texture->Height / 2 };
+
+    // Each kind of primitive gets its own loop over the visible rows, so
+    // sprites and glyphs do not alternate textures within one batch. The
+    // list wraps around at ContentHeight.
+    s32 FirstRow = Offset / RowHeight;
+    s32 LastRow = (Offset + Content.Height - 1) / RowHeight;
+
+    for (s32 Row = FirstRow; Row <= LastRow; Row++)
+    {
+        s32 Y = Content.Y + Row * RowHeight - Offset;
+        DrawRect(Content.X, Y + RowHeight - 1, Content.Width, 1, color{ 60, 66, 80, 255 });
+        DrawTexture(Texture, SrcRect, rect{ Content.X + 4, Y + 4, 32, 32 }, COLOR_WHITE);
+    }
+
+    for (s32 Row = FirstRow; Row <= LastRow; Row++)
+    {
+        f32 X = (f32)Content.X;
+        f32 Y = (f32)(Content.Y + Row * RowHeight - Offset);
+        color Accent = color{ (u8)(120 + Row % RowCount * 4), 180, (u8)(250 - Row % RowCount * 4), 255 };
+        DrawCircle(X + 56.0f, Y + 20.0f, 12.0f, Accent);
+        DrawRoundedRect(X + 76.0f, Y + 12.0f, (f32)(Content.Width - 180), 16.0f, 8.0f, Accent);
+    }
+
+    for (s32 Row = FirstRow; Font && Row <= LastRow; Row++)
+    {
+        f32 X = (f32)Content.X;
+        f32 Y = (f32)(Content.Y + Row * RowHeight - Offset);
+        char Label[16];
+        snprintf(Label, sizeof(Label), "Item %d", Row % RowCount);
+        DrawText(Font, Label, X + (f32)(Content.Width - 96), Y + 4.0f, COLOR_WHITE);
+        DrawTextScaled(Font, "new", X + (f32)(Content.Width - 36), Y + 10.0f, 14.0f, -0.5f, color{ 255, 200, 80, 255 });
+    }
+
+    PopClipRect();
+}
+
+// Tessellation speed without the cache, then a frame loop where a tenth of
+// the polygons change every frame and the rest hit the cache.
+internal void RunPolygonBenchmark()
+{
+    u32 PointCounts[] = { 8, 64, 512, 4096 };
+    s32 Iterations = 10;
+
+    printf("Ear clipping, star polygons\n");
+    printf("  points  polygons  Mpts/s\n");
+
+    for (u32 CountIndex = 0; CountIndex < sizeof(PointCounts) / sizeof(PointCounts[0]); CountIndex++)
+    {
+        u32 Count = PointCounts[CountIndex];
+        u32 PolygonCount = glm::max(65536u / Count, 4u);
+        vec2* Points = (vec2*)malloc(sizeof(vec2) * Count);
+        u32* Indices = (u32*)malloc(sizeof(u32) * (Count - 2) * 3);
+        MakeStarPolygon(Points, Count, vec2(640.0f, 360.0f), 300.0f);
+
+        f64 Start = GetWallClock();
+        for (s32 Iteration = 0; Iteration < Iterations; Iteration++)
+        {
+            for (u32 Polygon = 0; Polygon < PolygonCount; Polygon++) TriangulatePolygon(Points, Count, Indices);
+        }
+        f64 Elapsed = GetWallClock() - Start;
+
+        printf("%8u %9u %7.1f\n", Count, PolygonCount, (f64)Count * PolygonCount * Iterations / Elapsed / 1e6);
+
+        free(Points);
+        free(Indices);
+    }
+
+    u32 PolygonCount = 1000;
+    u32 Count = 32;
+    vec2* Points = (vec2*)malloc(sizeof(vec2) * Count * PolygonCount);
+
+    for (u32 Polygon = 0; Polygon < PolygonCount; Polygon++)
+    {
+        MakeStarPolygon(Points + Polygon * Count, Count, vec2(rand() % 1280, rand() % 720), 20.0f);
+    }
+
+    render_context* Context = CreateRenderContext(0);
+    BeginRenderContext(Context);
+    TakeTessellationStats();
+
+    f64 Start = GetWallClock();
+    for (s32 Frame = 0; Frame < 100; Frame++)
+    {
+        for (u32 Polygon = Frame % 10; Polygon < PolygonCount; Polygon += 10)
+        {
+            MakeStarPolygon(Points + Polygon * Count, Count, vec2(rand() % 1280, rand() % 720), 20.0f);
+        }
+
+        for (u32 Polygon = 0; Polygon < PolygonCount; Polygon++) DrawPolygon(Points + Polygon * Count, Count, COLOR_WHITE);
+        ResetRenderContext(Context);
+    }
+    f64 Elapsed = (GetWallClock() - Start) / 100;
+
+    EndRenderContext();
+    FreeRenderContext(Context);
+    tessellation_stats Stats = TakeTessellationStats();
+    printf("%u polygons of %u points, 10%% changing per frame: %.3f ms/frame, %.1f%% cache hits\n",
+        PolygonCount, Count, Elapsed * 1000.0, 100.0 * Stats.Hits / (Stats.Hits + Stats.Misses));
+
+    free(Points);
+}
+
+internal f32 DistanceToSegment(vec2 P, vec2 A, vec2 B)
+{
+    vec2 AB = B - A;
+    f32 LengthSquared = glm::dot(AB, AB);
+    f32 T = LengthSquared > 0.0f ? glm::clamp(glm::dot(P - A, AB) / LengthSquared, 0.0f, 1.0f) : 0.0f;
+    return glm::length(P - (A + AB * T));
+}
+
+// Largest distance from the exact samples to the nearest chord.
+internal f32 MeasureChordError(const vec2* Points, u32 Count, bool Closed, const vec2* Samples, u32 SampleCount)
+{
+    u32 ChordCount = Closed ? Count : Count - 1;
+    f32 MaxError = 0.0f;
+
+    for (u32 Sample = 0; Sample < SampleCount; Sample++)
+    {
+        f32 Error = FLT_MAX;
+        for (u32 i = 0; i < ChordCount; i++)
+        {
+            Error = glm::min(Error, DistanceToSegment(Samples[Sample], Points[i], Points[(i + 1) % Count]));
+        }
+        MaxError = glm::max(MaxError, Error);
+    }
+    return MaxError;
+}
+
+internal vec2 RandomPoint(f32 Size)
+{
+    return vec2(RandomUnit() * Size, RandomUnit() * Size);
+}
+
+// Flattens random curves of each size at a few tolerances and compares the
+// chords with densely sampled exact curves, then times DrawCubicBeziers.
+// The error column must stay at or below the tolerance.
+internal void RunCurveBenchmark()
+{
+    const u32 SampleCount = 1024;
+    const u32 CurveCount = 100;
+    f32 Tolerances[] = { 0.1f, 0.25f, 1.0f };
+    f32 Sizes[] = { 10.0f, 100.0f, 1000.0f };
+    const char* Kinds[] = { "quad", "cubic", "arc" };
+
+    vec2* Points = GetCurveScratch(CURVE_MAX_SEGMENTS + 1);
+    vec2* Samples = (vec2*)malloc(sizeof(vec2) * SampleCount);
+
+    // Benchmarks run without InitRenderer, so nothing scales the view
+    RenderState.PixelsPerUnit = 1.0f;
+
+    printf("Curve flattening, chords against %u exact samples per curve\n", SampleCount);
+    printf("  curve  tolerance   size  points/curve  error px\n");
+
+    for (u32 Kind = 0; Kind < 3; Kind++)
+    {
+        for (u32 ToleranceIndex = 0; ToleranceIndex < sizeof(Tolerances) / sizeof(Tolerances[0]); ToleranceIndex++)
+        {
+            SetCurveTolerance(Tolerances[ToleranceIndex]);
+
+            for (u32 SizeIndex = 0; SizeIndex < sizeof(Sizes) / sizeof(Sizes[0]); SizeIndex++)
+            {
+                f32 Size = Sizes[SizeIndex];
+                u32 TotalPoints = 0;
+                f32 MaxError = 0.0f;
+
+                for (u32 Curve = 0; Curve < CurveCount; Curve++)
+                {
+                    vec2 P0 = RandomPoint(Size), P1 = RandomPoint(Size), P2 = RandomPoint(Size), P3 = RandomPoint(Size);
+                    f32 Radius = Size * (0.05f + 0.45f * RandomUnit());
+                    f32 Start = RandomUnit() * 6.2831853f;
+                    f32 Sweep = (RandomUnit() * 2.0f - 1.0f) * 6.2831853f;
+
+                    u32 Count = 0;
+                    if (Kind == 0) Count = FlattenQuadratic(P0, P1, P2, Points);
+                    if (Kind == 1) Count = FlattenCubic(P0, P1, P2, P3, Points);
+                    if (Kind == 2) Count = FlattenArc(P0, Radius, Start, Sweep, 0.0f, false, Points);
+
+                    for (u32 Sample = 0; Sample < SampleCount; Sample++)
+                    {
+                        f32 T = (f32)Sample / (SampleCount - 1);
+                        f32 U = 1.0f - T;
+                        if (Kind == 0) Samples[Sample] = P0 * (U * U) + P1 * (2.0f * U * T) + P2 * (T * T);
+                        if (Kind == 1) Samples[Sample] = P0 * (U * U * U) + P1 * (3.0f * U * U * T) + P2 * (3.0f * U * T * T) + P3 * (T * T * T);
+                        if (Kind == 2) Samples[Sample] = P0 + vec2(cosf(Start + Sweep * T), sinf(Start + Sweep * T)) * Radius;
+                    }
+
+                    TotalPoints += Count;
+                    MaxError = glm::max(MaxError, MeasureChordError(Points, Count, false, Samples, SampleCount));
+                }
+
+                printf("  %-5s %10.2f %6.0f %13.1f %9.3f\n", Kinds[Kind], Tolerances[ToleranceIndex], Size,
+                    (f64)TotalPoints / CurveCount, MaxError);
+            }
+        }
+    }
+
+    SetCurveTolerance(CURVE_DEFAULT_TOLERANCE);
+
+    u32 BulkCount = 10000;
+    vec2* ControlPoints = (vec2*)malloc(sizeof(vec2) * 4 * BulkCount);
+    u32 BulkPoints = 0;
+
+    for (u32 Curve = 0; Curve < BulkCount; Curve++)
+    {
+        vec2 Corner = vec2(rand() % 1080, rand() % 520);
+        for (u32 i = 0; i < 4; i++) ControlPoints[Curve * 4 + i] = Corner + RandomPoint(200.0f);
+        BulkPoints += FlattenCubic(ControlPoints[Curve * 4], ControlPoints[Curve * 4 + 1],
+            ControlPoints[Curve * 4 + 2], ControlPoints[Curve * 4 + 3], Points);
+    }
+
+    render_context* Context = CreateRenderContext(0);
+    BeginRenderContext(Context);
+
+    s32 Iterations = 20;
+    f64 Start = GetWallClock();
+    for (s32 Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        DrawCubicBeziers(ControlPoints, BulkCount, COLOR_WHITE);
+        ResetRenderContext(Context);
+    }
+    f64 Elapsed = (GetWallClock() - Start) / Iterations;
+
+    EndRenderContext();
+    FreeRenderContext(Context);
+    printf("DrawCubicBeziers, %u curves of up to 200 px, tolerance %.2f: %.3f ms, %.1f points/curve, %.1f Mpts/s\n",
+        BulkCount, CURVE_DEFAULT_TOLERANCE, Elapsed * 1000.0, (f64)BulkPoints / BulkCount, BulkPoints / Elapsed / 1e6);
+
+    free(ControlPoints);
+    free(Samples);
+}
+
+// The fragment shader every primitive used before shader variants: it
+// always samples the texture and picks the result with a uniform.
+internal void InitMixShaderVariant(shader_variant* Variant)
+{
+    const char* VertexShaderCode = GLSL(
+        in vec2 VertPosition;
+        in vec2 VertTexCoord;
+        in vec4 VertColor;
+
+        out vec4 Color;
+        out vec2 TexCoord;
+
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform vec3 Origin;
+
+        void main()
+        {
+            gl_Position = Projection * ModelView * vec4(vec3(VertPosition, 0.0) + Origin, 1.0);
+            Color = VertColor;
+            TexCoord = VertTexCoord;
+        }
+    );
+
+    const char* FragmentShaderCode = GLSL(
+        in vec4 Color;
+        in vec2 TexCoord;
+        out vec4 FragColor;
+
+        uniform sampler2D Texture;
+        uniform float HasTexture;
+
+        void main()
+        {
+            FragColor = mix(Color, texture(Texture, TexCoord) * Color, HasTexture);
+        }
+    );
+
+    InitShaderVariant(Variant, VertexShaderCode, FragmentShaderCode);
+}
+
+// Time to fill Layers untextured full-screen rects per frame, drawn with
+// the untextured variant and then with the old mix() shader in its place.
+// Each frame is bracketed by glFinish, so the wall clock covers the GPU work;
+// software rasterizers do not report it through timer queries.
+internal void RunFillBenchmark(u32 Layers)
+{
+    s32 Width = RenderState.FramebufferWidth;
+    s32 Height = RenderState.FramebufferHeight;
+    s32 Iterations = 20;
+
+    shader_variant Untextured = RenderState.Variants[0];
+    shader_variant Mix;
+    InitMixShaderVariant(&Mix);
+
+    printf("Untextured fill, %u full-screen rects of %dx%d per frame\n", Layers, Width, Height);
+    printf("  shader   ms/frame  Gpix/s\n");
+
+    const char* Names[] = { "variant", "mix()" };
+    f64 Times[2];
+
+    for (s32 Shader = 0; Shader < 2; Shader++)
+    {
+        RenderState.Variants[0] = Shader ? Mix : Untextured;
+        f64 Total = 0;
+
+        // The first frame is a warm-up and is not counted
+        for (s32 Iteration = -1; Iteration < Iterations; Iteration++)
+        {
+            BeginFrame();
+            ClearScreen(COLOR_BLACK);
+            glFinish();
+
+            f64 Start = GetWallClock();
+            for (u32 Layer = 0; Layer < Layers; Layer++)
+            {
+                u8 Shade = (u8)(Layer * 255 / Layers);
+                DrawRect(0, 0, Width, Height, color{ Shade, 0, (u8)(255 - Shade), 255 });
+            }
+            FlushRenderBatches();
+            glFinish();
+            if (Iteration >= 0) Total += GetWallClock() - Start;
+
+            EndFrame();
+        }
+
+        Times[Shader] = Total / Iterations;
+        printf("  %-7s %9.3f %7.2f\n", Names[Shader], Times[Shader] * 1000.0,
+            (f64)Width * Height * Layers / Times[Shader] / 1e9);
+    }
+
+    printf("variant speedup: %.2fx\n", Times[1] / Times[0]);
+
+    RenderState.Variants[0] = Untextured;
+    glDeleteProgram(Mix.Program);
+}
@@ -0,0 +1,563 @@
+global text_system TextSystem;
+global thread_local glyph_quad* QuadScratch;
+global thread_local u32 QuadScratchCapacity;
+
+/*
+================================
+Glyph Atlas
+================================
+*/
+
+// Call on the GL thread after InitRenderer and before a render thread is
+// started.
+global void InitTextSystem()
+{
+    TextSystem.Atlas = {};
+    TextSystem.Atlas.Texture = CreateDynamicTexture(FONT_ATLAS_SIZE, FONT_ATLAS_SIZE);
+    TextSystem.Layouts = (text_layout*)calloc(TEXT_LAYOUT_SLOTS, sizeof(text_layout));
+}
+
+// Frames that were recorded but not drawn yet may still sample the shelf.
+internal bool ShelfInFlight(atlas_shelf* Shelf)
+{
+    return Shelf->LastUsedFrame + RENDER_MAX_FRAMES_IN_FLIGHT >= RenderState.FrameIndex;
+}
+
+// Returns the shelf the Width x Height block was placed on, or -1 when the
+// atlas is full of glyphs that are still in use.
+internal s32 AllocateGlyph(glyph_atlas* Atlas, s32 Width, s32 Height, s32* X, s32* Y)
+{
+    // One pixel of padding keeps linear filtering away from the neighbors
+    s32 PaddedWidth = Width + 1;
+    s32 PaddedHeight = Height + 1;
+    s32 Best = -1;
+
+    for (s32 i = 0; i < Atlas->ShelfCount; i++)
+    {
+        atlas_shelf* Shelf = Atlas->Shelves + i;
+        if (Shelf->Height < PaddedHeight || Shelf->Height > PaddedHeight * 2) continue;
+        if (Shelf->Cursor + PaddedWidth > FONT_ATLAS_SIZE) continue;
+        if (Best < 0 || Shelf->Height < Atlas->Shelves[Best].Height) Best = i;
+    }
+
+    if (Best < 0 && Atlas->ShelfCount < FONT_ATLAS_MAX_SHELVES)
+    {
+        s32 ShelfHeight = (PaddedHeight + 7) & ~7;
+        if (Atlas->NextY + ShelfHeight <= FONT_ATLAS_SIZE)
+        {
+            Best = Atlas->ShelfCount++;
+            atlas_shelf* Shelf = Atlas->Shelves + Best;
+            *Shelf = {};
+            Shelf->Y = Atlas->NextY;
+            Shelf->Height = ShelfHeight;
+            Atlas->NextY += ShelfHeight;
+        }
+    }
+
+    if (Best < 0)
+    {
+        for (s32 i = 0; i < Atlas->ShelfCount; i++)
+        {
+            atlas_shelf* Shelf = Atlas->Shelves + i;
+            if (Shelf->Height < PaddedHeight || ShelfInFlight(Shelf)) continue;
+            if (Best < 0 || Shelf->LastUsedFrame < Atlas->Shelves[Best].LastUsedFrame) Best = i;
+        }
+
+        if (Best < 0)
+        {
+            Atlas->Failures++;
+            return -1;
+        }
+
+        atlas_shelf* Shelf = Atlas->Shelves + Best;
+        UpdateDynamicTexture(Atlas->Texture, 0, Shelf->Y, FONT_ATLAS_SIZE, Shelf->Height, 0, 0);
+        Shelf->Cursor = 0;
+        Shelf->Generation++;
+        Atlas->Epoch++;
+        Atlas->Evictions++;
+    }
+
+    atlas_shelf* Shelf = Atlas->Shelves + Best;
+    *X = Shelf->Cursor;
+    *Y = Shelf->Y;
+    Shelf->Cursor += PaddedWidth;
+    Shelf->LastUsedFrame = RenderState.FrameIndex;
+    return Best;
+}
+
+/*
+================================
+Font
+================================
+*/
+
+internal font* OpenFont(const char* Path, f32 PixelHeight, bool Sdf)
+{
+    FILE* File = fopen(Path, "rb");
+    if (!File)
+    {
+        printf("Cannot open font %s\n", Path);
+        return 0;
+    }
+
+    fseek(File, 0, SEEK_END);
+    long Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    u8* Data = (u8*)malloc(Size);
+    bool Read = fread(Data, 1, Size, File) == (size_t)Size;
+    fclose(File);
+
+    font* Font = (font*)calloc(1, sizeof(font));
+
+    if (!Read || !stbtt_InitFont(&Font->Info, Data, stbtt_GetFontOffsetForIndex(Data, 0)))
+    {
+        printf("Cannot load font %s\n", Path);
+        free(Data);
+        free(Font);
+        return 0;
+    }
+
+    s32 Ascent, Descent, LineGap;
+    stbtt_GetFontVMetrics(&Font->Info, &Ascent, &Descent, &LineGap);
+
+    Font->Data = Data;
+    Font->Sdf = Sdf;
+    Font->PixelHeight = PixelHeight;
+    Font->Scale = stbtt_ScaleForPixelHeight(&Font->Info, PixelHeight);
+    Font->Ascent = Ascent * Font->Scale;
+    Font->Descent = Descent * Font->Scale;
+    Font->LineGap = LineGap * Font->Scale;
+
+    std::lock_guard<std::mutex> Guard(TextSystem.Lock);
+    Font->Id = ++TextSystem.FontCount;
+    return Font;
+}
+
+// Returns 0 if the file cannot be read or is not a TrueType font. Call
+// InitTextSystem first.
+global font* LoadFont(const char* Path, f32 PixelHeight)
+{
+    return OpenFont(Path, PixelHeight, false);
+}
+
+// Glyphs are baked once as distance fields at PixelHeight and drawn at any
+// size with DrawTextScaled. Around 32 pixels keeps corners crisp up to
+// several times that size.
+global font* LoadSdfFont(const char* Path, f32 PixelHeight)
+{
+    return OpenFont(Path, PixelHeight, true);
+}
+
+global void FreeFont(font* Font)
+{
+    free(Font->Data);
+    free(Font);
+}
+
+// Finds or adds the entry for Codepoint. The metrics are filled in on
+// first use; rasterization happens separately, so an evicted glyph keeps
+// its entry. A full table simply starts over.
+internal glyph_entry* FindGlyph(font* Font, u32 Codepoint)
+{
+    u32 Key = Codepoint + 1;
+    u32 Slot = (Codepoint * 2654435761u) & (FONT_GLYPH_SLOTS - 1);
+
+    for (;;)
+    {
+        glyph_entry* Entry = Font->Glyphs + Slot;
+        if (Entry->Key == Key) return Entry;
+        if (!Entry->Key) break;
+        Slot = (Slot + 1) & (FONT_GLYPH_SLOTS - 1);
+    }
+
+    if (Font->GlyphCount >= FONT_GLYPH_SLOTS * 3 / 4)
+    {
+        memset(Font->Glyphs, 0, sizeof(Font->Glyphs));
+        Font->GlyphCount = 0;
+        Slot = (Codepoint * 2654435761u) & (FONT_GLYPH_SLOTS - 1);
+    }
+
+    glyph_entry* Entry = Font->Glyphs + Slot;
+    *Entry = {};
+    Entry->Key = Key;
+    Entry->Glyph = stbtt_FindGlyphIndex(&Font->Info, (s32)Codepoint);
+    Entry->Shelf = -1;
+
+    s32 Advance, LeftBearing;
+    stbtt_GetGlyphHMetrics(&Font->Info, Entry->Glyph, &Advance, &LeftBearing);
+    Entry->Advance = Advance * Font->Scale;
+
+    s32 X0, Y0, X1, Y1;
+    stbtt_GetGlyphBitmapBox(&Font->Info, Entry->Glyph, Font->Scale, Font->Scale, &X0, &Y0, &X1, &Y1);
+
+    // Distance fields extend past the outline by the padding on every side
+    if (Font->Sdf && X1 > X0 && Y1 > Y0)
+    {
+        X0 -= FONT_SDF_PADDING;
+        Y0 -= FONT_SDF_PADDING;
+        X1 += FONT_SDF_PADDING;
+        Y1 += FONT_SDF_PADDING;
+    }
+    Entry->OffsetX = X0;
+    Entry->OffsetY = Y0;
+    Entry->Width = X1 - X0;
+    Entry->Height = Y1 - Y0;
+
+    Font->GlyphCount++;
+    return Entry;
+}
+
+// Makes sure the glyph's pixels are in the atlas and marks its shelf as
+// used this frame. Returns false if there is no room for it.
+internal bool RasterizeGlyph(text_system* System, font* Font, glyph_entry* Entry)
+{
+    glyph_atlas* Atlas = &System->Atlas;
+
+    if (Entry->Shelf >= 0 && Atlas->Shelves[Entry->Shelf].Generation == Entry->Generation)
+    {
+        Atlas->Shelves[Entry->Shelf].LastUsedFrame = RenderState.FrameIndex;
+        return true;
+    }
+
+    s32 Shelf = AllocateGlyph(Atlas, Entry->Width, Entry->Height, &Entry->AtlasX, &Entry->AtlasY);
+    if (Shelf < 0) return false;
+
+    if (Font->Sdf)
+    {
+        // The outline sits at 0.5 and the field falls to 0 at the padding
+        s32 Width, Height, OffsetX, OffsetY;
+        u8* Distances = stbtt_GetGlyphSDF(&Font->Info, Font->Scale, Entry->Glyph, FONT_SDF_PADDING,
+            128, 128.0f / FONT_SDF_PADDING, &Width, &Height, &OffsetX, &OffsetY);
+
+        if (Distances)
+        {
+            UpdateDynamicTexture(Atlas->Texture, Entry->AtlasX, Entry->AtlasY,
+                glm::min(Width, Entry->Width), glm::min(Height, Entry->Height), Distances, Width);
+            stbtt_FreeSDF(Distances, 0);
+        }
+    }
+    else
+    {
+        u32 Size = Entry->Width * Entry->Height;
+        if (Size > System->ScratchSize)
+        {
+            System->Scratch = (u8*)realloc(System->Scratch, Size);
+            System->ScratchSize = Size;
+        }
+
+        stbtt_MakeGlyphBitmap(&Font->Info, System->Scratch, Entry->Width, Entry->Height, Entry->Width,
+            Font->Scale, Font->Scale, Entry->Glyph);
+        UpdateDynamicTexture(Atlas->Texture, Entry->AtlasX, Entry->AtlasY, Entry->Width, Entry->Height,
+            System->Scratch, Entry->Width);
+    }
+
+    Entry->Shelf = Shelf;
+    Entry->Generation = Atlas->Shelves[Shelf].Generation;
+    return true;
+}
+
+/*
+================================
+Text Layout
+================================
+*/
+
+// Invalid sequences decode as U+FFFD and consume one byte.
+internal u32 DecodeUtf8(const char** Text)
+{
+    const u8* Bytes = (const u8*)*Text;
+    u32 Codepoint = 0xFFFD;
+    s32 Length = 1;
+
+    if (Bytes[0] < 0x80)
+    {
+        Codepoint = Bytes[0];
+    }
+    else if ((Bytes[0] & 0xE0) == 0xC0 && (Bytes[1] & 0xC0) == 0x80)
+    {
+        Codepoint = ((Bytes[0] & 0x1F) << 6) | (Bytes[1] & 0x3F);
+        Length = 2;
+    }
+    else if ((Bytes[0] & 0xF0) == 0xE0 && (Bytes[1] & 0xC0) == 0x80 && (Bytes[2] & 0xC0) == 0x80)
+    {
+        Codepoint = ((Bytes[0] & 0x0F) << 12) | ((Bytes[1] & 0x3F) << 6) | (Bytes[2] & 0x3F);
+        Length = 3;
+    }
+    else if ((Bytes[0] & 0xF8) == 0xF0 && (Bytes[1] & 0xC0) == 0x80 && (Bytes[2] & 0xC0) == 0x80 && (Bytes[3] & 0xC0) == 0x80)
+    {
+        Codepoint = ((Bytes[0] & 0x07) << 18) | ((Bytes[1] & 0x3F) << 12) | ((Bytes[2] & 0x3F) << 6) | (Bytes[3] & 0x3F);
+        Length = 4;
+    }
+
+    *Text += Length;
+    return Codepoint;
+}
+
+internal glyph_quad* GetQuadScratch(u32 Count)
+{
+    if (Count > QuadScratchCapacity)
+    {
+        QuadScratchCapacity = glm::max(Count, QuadScratchCapacity * 2);
+        QuadScratch = (glyph_quad*)realloc(QuadScratch, sizeof(glyph_quad) * QuadScratchCapacity);
+    }
+    return QuadScratch;
+}
+
+// Lays Text out into the quad scratch, top-left at (0, 0), and returns the
+// number of quads. Blank glyphs and glyphs that found no room produce none.
+internal u32 LayoutText(text_system* System, font* Font, const char* Text, u64* ShelfMask)
+{
+    glyph_quad* Quads = GetQuadScratch((u32)strlen(Text));
+    f32 InvSize = 1.0f / FONT_ATLAS_SIZE;
+    f32 PenX = 0.0f;
+    f32 Baseline = floorf(Font->Ascent + 0.5f);
+    s32 Previous = -1;
+    u32 Count = 0;
+    *ShelfMask = 0;
+
+    while (*Text)
+    {
+        u32 Codepoint = DecodeUtf8(&Text);
+
+        if (Codepoint == '\n')
+        {
+            PenX = 0.0f;
+            Baseline += floorf(Font->Ascent - Font->Descent + Font->LineGap + 0.5f);
+            Previous = -1;
+            continue;
+        }
+
+        glyph_entry* Entry = FindGlyph(Font, Codepoint);
+        if (Previous >= 0) PenX += stbtt_GetGlyphKernAdvance(&Font->Info, Previous, Entry->Glyph) * Font->Scale;
+        Previous = Entry->Glyph;
+
+        if (Entry->Width > 0 && Entry->Height > 0 && RasterizeGlyph(System, Font, Entry))
+        {
+            // Bitmap glyphs stay sharp only on whole pixels
+            glyph_quad* Quad = Quads + Count++;
+            Quad->X0 = (Font->Sdf ? PenX : floorf(PenX + 0.5f)) + Entry->OffsetX;
+            Quad->Y0 = Baseline + Entry->OffsetY;
+            Quad->X1 = Quad->X0 + Entry->Width;
+            Quad->Y1 = Quad->Y0 + Entry->Height;
+            Quad->U0 = Entry->AtlasX * InvSize;
+            Quad->V0 = Entry->AtlasY * InvSize;
+            Quad->U1 = (Entry->AtlasX + Entry->Width) * InvSize;
+            Quad->V1 = (Entry->AtlasY + Entry->Height) * InvSize;
+            *ShelfMask |= 1ull << Entry->Shelf;
+        }
+
+        PenX += Entry->Advance;
+    }
+
+    return Count;
+}
+
+global f32 MeasureText(font* Font, const char* Text)
+{
+    std::lock_guard<std::mutex> Guard(TextSystem.Lock);
+    f32 Width = 0.0f;
+    f32 PenX = 0.0f;
+    s32 Previous = -1;
+
+    while (*Text)
+    {
+        u32 Codepoint = DecodeUtf8(&Text);
+
+        if (Codepoint == '\n')
+        {
+            PenX = 0.0f;
+            Previous = -1;
+            continue;
+        }
+
+        glyph_entry* Entry = FindGlyph(Font, Codepoint);
+        if (Previous >= 0) PenX += stbtt_GetGlyphKernAdvance(&Font->Info, Previous, Entry->Glyph) * Font->Scale;
+        Previous = Entry->Glyph;
+        PenX += Entry->Advance;
+        Width = glm::max(Width, PenX);
+    }
+
+    return Width;
+}
+
+// Appends the quads to the sprite batch, scaled by Scale and rotated by
+// Rotation radians around the label's top-left corner at (X, Y). Upright
+// glyphs are clipped one by one on the CPU; rotated labels are culled or
+// scissored as a whole.
+internal void EmitGlyphQuads(font* Font, const glyph_quad* Quads, u32 Count, f32 X, f32 Y, f32 Scale, f32 Rotation, color Color)
+{
+    typedef batch_format<R_TEXTURES>::type format;
+
+    u32 QuadsPerWindow = RENDER_BATCH_MAX_CAPACITY / 4;
+    batch_key Key = MakeBatchKey(TextSystem.Atlas.Texture->Texture.Handle);
+    if (Font->Sdf) Key.Features |= SHADER_SDF;
+
+    vec2 Offset = BatchPosition(Key, X, Y);
+    vec2 AxisX = vec2(cosf(Rotation), sinf(Rotation)) * Scale;
+    vec2 AxisY = vec2(-AxisX.y, AxisX.x);
+
+    const rect* Clip = CurrentClip();
+    if (Clip && Rotation != 0.0f)
+    {
+        if (!Count) return;
+
+        f32 MinX = Quads[0].X0, MinY = Quads[0].Y0, MaxX = Quads[0].X1, MaxY = Quads[0].Y1;
+        for (u32 i = 1; i < Count; i++)
+        {
+            MinX = fminf(MinX, Quads[i].X0);
+            MinY = fminf(MinY, Quads[i].Y0);
+            MaxX = fmaxf(MaxX, Quads[i].X1);
+            MaxY = fmaxf(MaxY, Quads[i].Y1);
+        }
+
+        vec2 Origin = vec2(X, Y);
+        vec2 Corners[] = {
+            Origin + AxisX * MinX + AxisY * MinY,
+            Origin + AxisX * MinX + AxisY * MaxY,
+            Origin + AxisX * MaxX + AxisY * MaxY,
+            Origin + AxisX * MaxX + AxisY * MinY
+        };
+        if (!ClipPointsKey(&Key, Corners, 4, 0.0f)) return;
+        Clip = 0;
+    }
+
+    for (u32 First = 0; First < Count; First += QuadsPerWindow)
+    {
+        u32 WindowCount = glm::min(Count - First, QuadsPerWindow);
+        render_batch* RenderBatch = ReserveBatch(R_TEXTURES, Key, WindowCount * 4, WindowCount * 6);
+        vertex_buffer* Buffer = &RenderBatch->Buffer;
+
+        for (u32 i = First; i < First + WindowCount; i++)
+        {
+            glyph_quad Quad = Quads[i];
+            u32 Vertex = Buffer->VertexCount;
+
+            if (Clip)
+            {
+                // Upright, so the quad is Scale times its layout box at (X, Y)
+                f32 X0 = X + Quad.X0 * Scale, Y0 = Y + Quad.Y0 * Scale;
+                f32 X1 = X + Quad.X1 * Scale, Y1 = Y + Quad.Y1 * Scale;
+                if (!ClipQuad(*Clip, &X0, &Y0, &X1, &Y1, &Quad.U0, &Quad.V0, &Quad.U1, &Quad.V1)) continue;
+
+                Quad.X0 = (X0 - X) / Scale;
+                Quad.Y0 = (Y0 - Y) / Scale;
+                Quad.X1 = (X1 - X) / Scale;
+                Quad.Y1 = (Y1 - Y) / Scale;
+            }
+
+            vertex_input Corners[] = {
+                { Offset + AxisX * Quad.X0 + AxisY * Quad.Y0, vec2(Quad.U0, Quad.V0), Color },
+                { Offset + AxisX * Quad.X0 + AxisY * Quad.Y1, vec2(Quad.U0, Quad.V1), Color },
+                { Offset + AxisX * Quad.X1 + AxisY * Quad.Y1, vec2(Quad.U1, Quad.V1), Color },
+                { Offset + AxisX * Quad.X1 + AxisY * Quad.Y0, vec2(Quad.U1, Quad.V0), Color }
+            };
+
+            for (s32 Corner = 0; Corner < 4; Corner++)
+            {
+                format::Write(Buffer->Vertices + (Vertex + Corner) * format::Stride, Corners[Corner]);
+            }
+
+            u32* Indices = Buffer->Indices + Buffer->ElementCount;
+            Indices[0] = Vertex + 0;
+            Indices[1] = Vertex + 1;
+            Indices[2] = Vertex + 2;
+            Indices[3] = Vertex + 0;
+            Indices[4] = Vertex + 2;
+            Indices[5] = Vertex + 3;
+
+            Buffer->VertexCount += 4;
+            Buffer->ElementCount += 6;
+        }
+    }
+}
+
+// Returns the quads of Text in this thread's quad scratch. Repeated strings
+// reuse their cached layout, so an unchanged label costs a hash and a copy.
+internal u32 GetTextQuads(font* Font, const char* Text, glyph_quad** Result)
+{
+    text_system* System = &TextSystem;
+    u64 Hash = HashString(Text, 0xcbf29ce484222325ull ^ Font->Id);
+    glyph_quad* Quads;
+    u32 Count;
+
+    {
+        std::lock_guard<std::mutex> Guard(System->Lock);
+        glyph_atlas* Atlas = &System->Atlas;
+        text_layout* Set = System->Layouts + (Hash & (TEXT_LAYOUT_SLOTS - 2));
+        text_layout* Layout = Set;
+        if (Set[1].Hash == Hash && Set[1].Font == Font) Layout = Set + 1;
+
+        if (Layout->Hash == Hash && Layout->Font == Font && Layout->Epoch == Atlas->Epoch)
+        {
+            Layout->LastUsedFrame = RenderState.FrameIndex;
+
+            u64 Mask = Layout->ShelfMask;
+            for (s32 Shelf = 0; Mask; Shelf++, Mask >>= 1)
+            {
+                if (Mask & 1) Atlas->Shelves[Shelf].LastUsedFrame = RenderState.FrameIndex;
+            }
+
+            Count = Layout->GlyphCount;
+            Quads = GetQuadScratch(Count);
+            memcpy(Quads, Layout->Quads, sizeof(glyph_quad) * Count);
+            System->LayoutHits++;
+        }
+        else
+        {
+            u64 ShelfMask;
+            u32 Failures = Atlas->Failures;
+            Count = LayoutText(System, Font, Text, &ShelfMask);
+            Quads = QuadScratch;
+            System->LayoutMisses++;
+
+            // Glyphs that found no room are retried next time
+            if (Count <= TEXT_LAYOUT_MAX_GLYPHS && Atlas->Failures == Failures)
+            {
+                // A stale entry for this string is refreshed in place,
+                // otherwise the way used longer ago is replaced
+                if (Layout->Hash != Hash || Layout->Font != Font)
+                {
+                    Layout = Set[0].LastUsedFrame <= Set[1].LastUsedFrame ? Set : Set + 1;
+                }
+
+                Layout->Hash = Hash;
+                Layout->Font = Font;
+                Layout->Epoch = Atlas->Epoch;
+                Layout->LastUsedFrame = RenderState.FrameIndex;
+                Layout->ShelfMask = ShelfMask;
+                Layout->GlyphCount = Count;
+                memcpy(Layout->Quads, Quads, sizeof(glyph_quad) * Count);
+            }
+        }
+    }
+
+    *Result = Quads;
+    return Count;
+}
+
+// Draws Text at the font's size with its top-left corner at (X, Y). Safe to
+// call from any recording thread.
+global void DrawText(font* Font, const char* Text, f32 X, f32 Y, color Color)
+{
+    glyph_quad* Quads;
+    u32 Count = GetTextQuads(Font, Text, &Quads);
+
+    // Outside the text lock, since a full batch flushes and uploads the atlas
+    if (!Font->Sdf)
+    {
+        X = floorf(X + 0.5f);
+        Y = floorf(Y + 0.5f);
+    }
+    EmitGlyphQuads(Font, Quads, Count, X, Y, 1.0f, 0.0f, Color);
+}
+
+// Draws Text PixelHeight pixels high, rotated by Rotation radians around
+// its top-left corner. Meant for SDF fonts, which stay sharp at any size
+// from the same atlas glyphs; bitmap fonts are stretched.
+global void DrawTextScaled(font* Font, const char* Text, f32 X, f32 Y, f32 PixelHeight, f32 Rotation, color Color)
+{
+    glyph_quad* Quads;
+    u32 Count = GetTextQuads(Font, Text, &Quads);
+    EmitGlyphQuads(Font, Quads, Count, X, Y, PixelHeight / Font->PixelHeight, Rotation, Color);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#define FONT_ATLAS_SIZE 2048
+#define FONT_ATLAS_MAX_SHELVES 64
+#define FONT_GLYPH_SLOTS 1024
+#define TEXT_LAYOUT_SLOTS 4096
+#define TEXT_LAYOUT_MAX_GLYPHS 32
+#define FONT_SDF_PADDING 6
+
+// A horizontal strip of the atlas. Glyphs are appended left to right and
+// the strip as a whole is the unit of eviction.
+struct atlas_shelf
+{
+    s32 Y;
+    s32 Height;
+    s32 Cursor;
+    u32 LastUsedFrame;
+    u32 Generation;
+};
+
+// One atlas page shared by every font. When no shelf fits a new glyph, the
+// least recently used shelf that no frame in flight can still sample is
+// cleared and reused. Epoch changes with every eviction.
+struct glyph_atlas
+{
+    dynamic_texture* Texture;
+    atlas_shelf Shelves[FONT_ATLAS_MAX_SHELVES];
+    s32 ShelfCount;
+    s32 NextY;
+    u32 Epoch;
+    u32 Evictions;
+    u32 Failures;
+};
+
+// Key is the codepoint + 1, so zeroed slots are empty. A glyph is in the
+// atlas while its shelf still has the generation it was rasterized into.
+struct glyph_entry
+{
+    u32 Key;
+    s32 Glyph;
+    f32 Advance;
+    s32 OffsetX;
+    s32 OffsetY;
+    s32 Width;
+    s32 Height;
+    s32 AtlasX;
+    s32 AtlasY;
+    s32 Shelf;
+    u32 Generation;
+};
+
+// One face at one pixel height. SDF fonts store distance fields instead
+// of coverage and are drawn with the SHADER_SDF variant.
+struct font
+{
+    stbtt_fontinfo Info;
+    u8* Data;
+    u32 Id;
+    bool Sdf;
+    f32 PixelHeight;
+    f32 Scale;
+    f32 Ascent;
+    f32 Descent;
+    f32 LineGap;
+    glyph_entry Glyphs[FONT_GLYPH_SLOTS];
+    u32 GlyphCount;
+};
+
+// Glyph rectangle relative to the label's top-left corner, and its UVs.
+struct glyph_quad
+{
+    f32 X0;
+    f32 Y0;
+    f32 X1;
+    f32 Y1;
+    f32 U0;
+    f32 V0;
+    f32 U1;
+    f32 V1;
+};
+
+// A laid out string, valid while the atlas epoch is unchanged. ShelfMask
+// has a bit for every shelf the quads sample.
+struct text_layout
+{
+    u64 Hash;
+    font* Font;
+    u32 Epoch;
+    u32 LastUsedFrame;
+    u64 ShelfMask;
+    u32 GlyphCount;
+    glyph_quad Quads[TEXT_LAYOUT_MAX_GLYPHS];
+};
+
+// Layouts live in a two-way set associative cache indexed by the string's
+// hash; strings longer than TEXT_LAYOUT_MAX_GLYPHS are laid out every time.
+struct text_system
+{
+    glyph_atlas Atlas;
+    text_layout* Layouts;
+    u8* Scratch;
+    u32 ScratchSize;
+    u32 FontCount;
+    u32 LayoutHits;
+    u32 LayoutMisses;
+    std::mutex Lock;
+};
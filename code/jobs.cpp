@@ -0,0 +1,173 @@
+global job_system JobSystem;
+global thread_local u32 JobQueueIndex;
+
+/*
+================================
+Job Queue
+================================
+*/
+
+internal bool PushJob(job_queue* Queue, const job& Job)
+{
+    std::lock_guard<std::mutex> Guard(Queue->Lock);
+    if (Queue->Bottom - Queue->Top == JOB_QUEUE_CAPACITY) return false;
+
+    Queue->Jobs[Queue->Bottom % JOB_QUEUE_CAPACITY] = Job;
+    Queue->Bottom++;
+    return true;
+}
+
+internal bool PopJob(job_queue* Queue, job* Job)
+{
+    std::lock_guard<std::mutex> Guard(Queue->Lock);
+    if (Queue->Bottom == Queue->Top) return false;
+
+    Queue->Bottom--;
+    *Job = Queue->Jobs[Queue->Bottom % JOB_QUEUE_CAPACITY];
+    return true;
+}
+
+internal bool StealJob(job_queue* Queue, job* Job)
+{
+    std::lock_guard<std::mutex> Guard(Queue->Lock);
+    if (Queue->Bottom == Queue->Top) return false;
+
+    *Job = Queue->Jobs[Queue->Top % JOB_QUEUE_CAPACITY];
+    Queue->Top++;
+    return true;
+}
+
+/*
+================================
+Job System
+================================
+*/
+
+internal void RunJob(const job& Job)
+{
+    Job.Function(Job.Data, Job.Start, Job.End);
+    Job.Counter->fetch_sub(1, std::memory_order_release);
+}
+
+internal bool TryRunJob(job_system* System, u32 QueueIndex)
+{
+    job Job;
+    bool Found = PopJob(System->Queues + QueueIndex, &Job);
+
+    for (u32 Offset = 1; !Found && Offset < System->ThreadCount; Offset++)
+    {
+        u32 Victim = (QueueIndex + Offset) % System->ThreadCount;
+        Found = StealJob(System->Queues + Victim, &Job);
+    }
+
+    if (!Found) return false;
+
+    System->PendingJobs.fetch_sub(1, std::memory_order_relaxed);
+    RunJob(Job);
+    return true;
+}
+
+internal void WorkerThread(job_system* System, u32 QueueIndex)
+{
+    JobQueueIndex = QueueIndex;
+
+    while (System->Running.load(std::memory_order_acquire))
+    {
+        if (TryRunJob(System, QueueIndex)) continue;
+
+        std::unique_lock<std::mutex> Lock(System->SleepLock);
+        System->WakeUp.wait(Lock, [System] {
+            return System->PendingJobs.load() > 0 || !System->Running.load();
+        });
+    }
+}
+
+// ThreadCount of 0 uses one thread per hardware core.
+global void InitJobSystem(job_system* System, u32 ThreadCount, u32 ChunkSize)
+{
+    if (!ThreadCount) ThreadCount = std::thread::hardware_concurrency();
+    if (!ThreadCount) ThreadCount = 1;
+
+    System->ThreadCount = ThreadCount;
+    System->ChunkSize = ChunkSize ? ChunkSize : JOB_DEFAULT_CHUNK_SIZE;
+    System->Queues = new job_queue[ThreadCount]();
+    System->Workers = new std::thread[ThreadCount];
+    System->PendingJobs = 0;
+    System->Running = true;
+
+    for (u32 WorkerIndex = 1; WorkerIndex < ThreadCount; WorkerIndex++)
+    {
+        System->Workers[WorkerIndex] = std::thread(WorkerThread, System, WorkerIndex);
+    }
+}
+
+global void ShutdownJobSystem(job_system* System)
+{
+    {
+        std::lock_guard<std::mutex> Guard(System->SleepLock);
+        System->Running = false;
+    }
+    System->WakeUp.notify_all();
+
+    for (u32 WorkerIndex = 1; WorkerIndex < System->ThreadCount; WorkerIndex++)
+    {
+        System->Workers[WorkerIndex].join();
+    }
+
+    delete[] System->Workers;
+    delete[] System->Queues;
+    System->Workers = 0;
+    System->Queues = 0;
+    System->ThreadCount = 0;
+}
+
+// Splits [0, Count) into chunks of ChunkSize (0 picks the system default)
+// and runs Function over them on the pool. The calling thread helps out and
+// returns once every chunk has finished.
+global void ParallelFor(job_system* System, u32 Count, job_function* Function, void* Data, u32 ChunkSize = 0)
+{
+    if (!ChunkSize) ChunkSize = System->ChunkSize;
+
+    if (System->ThreadCount <= 1 || Count <= ChunkSize)
+    {
+        Function(Data, 0, Count);
+        return;
+    }
+
+    u32 QueueIndex = JobQueueIndex;
+    u32 ChunkCount = (Count + ChunkSize - 1) / ChunkSize;
+    std::atomic<u32> Counter(ChunkCount);
+
+    // Spread chunks over all queues so workers start without stealing
+    for (u32 ChunkIndex = 0; ChunkIndex < ChunkCount; ChunkIndex++)
+    {
+        job Job = {};
+        Job.Function = Function;
+        Job.Data = Data;
+        Job.Start = ChunkIndex * ChunkSize;
+        Job.End = (Job.Start + ChunkSize < Count) ? Job.Start + ChunkSize : Count;
+        Job.Counter = &Counter;
+
+        u32 Target = (QueueIndex + ChunkIndex) % System->ThreadCount;
+        System->PendingJobs.fetch_add(1, std::memory_order_relaxed);
+
+        if (!PushJob(System->Queues + Target, Job))
+        {
+            System->PendingJobs.fetch_sub(1, std::memory_order_relaxed);
+            RunJob(Job);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> Guard(System->SleepLock);
+    }
+    System->WakeUp.notify_all();
+
+    while (Counter.load(std::memory_order_acquire) > 0)
+    {
+        if (!TryRunJob(System, QueueIndex))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#define JOB_QUEUE_CAPACITY 4096
+#define JOB_DEFAULT_CHUNK_SIZE 4096
+
+typedef void job_function(void* Data, u32 Start, u32 End);
+
+struct job
+{
+    job_function* Function;
+    void* Data;
+    u32 Start;
+    u32 End;
+    std::atomic<u32>* Counter;
+};
+
+// Ring buffer deque. The owner pushes and pops at the bottom, thieves take
+// from the top, so a stolen chunk is always the oldest one in the queue.
+struct job_queue
+{
+    std::mutex Lock;
+    job Jobs[JOB_QUEUE_CAPACITY];
+    u32 Top;
+    u32 Bottom;
+};
+
+// Queue 0 belongs to threads outside the pool (the main thread), queues
+// 1..ThreadCount-1 to the workers. ThreadCount includes the caller, so a
+// ThreadCount of 1 runs everything inline.
+struct job_system
+{
+    u32 ThreadCount;
+    u32 ChunkSize;
+    job_queue* Queues;
+    std::thread* Workers;
+    std::atomic<u32> PendingJobs;
+    std::atomic<bool> Running;
+    std::mutex SleepLock;
+    std::condition_variable WakeUp;
+};
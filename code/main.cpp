@@ -6,9 +6,22 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
 #include <stdlib.h>
 #include <time.h>
+#include <float.h>
 #include <stdio.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <stdint.h>
 
 #define internal static
@@ -34,112 +47,205 @@ typedef glm::vec3 vec3;
 typedef glm::vec4 vec4;
 typedef glm::mat4 mat4;
 
+#include "jobs.h"
 #include "renderer.h"
-
+#include "vertex_format.h"
+#include "particles.h"
+#include "spatial_hash.h"
+#include "polygon.h"
+#include "animation.h"
+#include "font.h"
+
+#include "jobs.cpp"
 #include "renderer.cpp"
+#include "particles.cpp"
+#include "spatial_hash.cpp"
+#include "polygon.cpp"
+#include "animation.cpp"
+#include "font.cpp"
+#include "benchmarks.cpp"
 
 global s32 WindowWidth = 1280;
 global s32 WindowHeight = 720;
 global s32 MouseX = 0;
 global s32 MouseY = 0;
 
-struct moving_rect
-{
-    vec2 Position;
-    vec2 Dir;
-    vec4 Color;
-    f32 Scale;
-    f32 Speed;
-};
-
-internal f32 GenerateRandomNumber()
+int main(int Argc, char** Argv)
 {
-    f32 Result = (f32)rand() / RAND_MAX;
-    return Result;
-}
+    srand(time(NULL));
 
-internal void UpdateMovingRects(moving_rect* Rects, s32 RectCount, f32 DeltaTime)
-{
-    for (s32 i = 0; i < RectCount; i++)
+    u32 ThreadCount = 0;
+    u32 ChunkSize = JOB_DEFAULT_CHUNK_SIZE;
+    u32 BenchmarkJobs = 0;
+    u32 FramesInFlight = 0;
+    u32 ParticleCount = 100000;
+    bool GpuParticles = false;
+    bool Separation = false;
+    bool BenchmarkSpatialHash = false;
+    bool BenchmarkPolygons = false;
+    bool BenchmarkCurves = false;
+    u32 BenchmarkFill = 0;
+    u32 PolygonCount = 0;
+    u32 SpriteCount = 0;
+    u32 CircleCount = 0;
+    u32 CurveCount = 0;
+    u32 PanelCount = 0;
+    const char* FontPath = 0;
+    u32 LabelCount = 0;
+    bool SdfFont = false;
+    bool DepthPasses = false;
+    u32 OverdrawLayers = 0;
+    bool Chart = false;
+    bool ScrollPanel = false;
+    bool LayerCache = true;
+
+    for (s32 ArgIndex = 1; ArgIndex < Argc; ArgIndex++)
     {
-        Rects[i].Position += Rects[i].Dir * Rects[i].Speed * DeltaTime;
-
-        f32 WorldWidth = (WindowWidth / 32.0f);
-        f32 WorldHeight = (WindowHeight / 32.0f);
-        f32 WorldMouseX = (MouseX / 32.0f);
-        f32 WorldMouseY = (MouseY / 32.0f);
-
-        vec2 MousePosition = vec2(WorldMouseX, WorldMouseY);
-        vec2 LineMouseRect = Rects[i].Position - MousePosition;
-        f32 MaxDistance = 2.0f;
-
-        f32 Distance2 = glm::dot(LineMouseRect, LineMouseRect);
-
-        if (Distance2 < MaxDistance*MaxDistance)
+        if (!strcmp(Argv[ArgIndex], "--threads") && ArgIndex + 1 < Argc)
         {
-            glm::vec2 Dir = glm::normalize(LineMouseRect);
-            Rects[i].Dir = Dir;
+            ThreadCount = (u32)atoi(Argv[++ArgIndex]);
         }
-
-        if (Rects[i].Position.x < 0)
+        else if (!strcmp(Argv[ArgIndex], "--chunk") && ArgIndex + 1 < Argc)
         {
-            Rects[i].Position.x = 0.0f;
-            Rects[i].Dir.x *= -1.0f;
+            ChunkSize = (u32)atoi(Argv[++ArgIndex]);
         }
-        else if (Rects[i].Position.x + Rects[i].Scale > WorldWidth)
+        else if (!strcmp(Argv[ArgIndex], "--particles") && ArgIndex + 1 < Argc)
         {
-            
-            Rects[i].Position.x = WorldWidth - Rects[i].Scale;
-            Rects[i].Dir.x *= -1.0f;
+            ParticleCount = (u32)atoi(Argv[++ArgIndex]);
         }
-
-        if (Rects[i].Position.y < 0)
+        else if (!strcmp(Argv[ArgIndex], "--gpu-particles"))
+        {
+            GpuParticles = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--separation"))
+        {
+            Separation = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--bench-spatial"))
+        {
+            BenchmarkSpatialHash = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--font") && ArgIndex + 1 < Argc)
+        {
+            FontPath = Argv[++ArgIndex];
+        }
+        else if (!strcmp(Argv[ArgIndex], "--sdf"))
+        {
+            SdfFont = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--labels") && ArgIndex + 1 < Argc)
+        {
+            LabelCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--polygons") && ArgIndex + 1 < Argc)
+        {
+            PolygonCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--sprites") && ArgIndex + 1 < Argc)
+        {
+            SpriteCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--circles") && ArgIndex + 1 < Argc)
+        {
+            CircleCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--curves") && ArgIndex + 1 < Argc)
+        {
+            CurveCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--panels") && ArgIndex + 1 < Argc)
+        {
+            PanelCount = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--depth"))
+        {
+            DepthPasses = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--overdraw") && ArgIndex + 1 < Argc)
+        {
+            OverdrawLayers = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--chart"))
+        {
+            Chart = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--scroll-panel"))
+        {
+            ScrollPanel = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--no-layer-cache"))
+        {
+            LayerCache = false;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--bench-polygons"))
         {
-            Rects[i].Position.y = 0.0f;
-            Rects[i].Dir.y *= -1.0f;
+            BenchmarkPolygons = true;
         }
-        else if (Rects[i].Position.y + Rects[i].Scale > WorldHeight)
+        else if (!strcmp(Argv[ArgIndex], "--bench-curves"))
         {
-            Rects[i].Position.y = WorldHeight - Rects[i].Scale;
-            Rects[i].Dir.y *= -1.0f;
+            BenchmarkCurves = true;
+        }
+        else if (!strcmp(Argv[ArgIndex], "--bench-fill"))
+        {
+            BenchmarkFill = 20;
+            if (ArgIndex + 1 < Argc && Argv[ArgIndex + 1][0] != '-') BenchmarkFill = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--render-thread"))
+        {
+            FramesInFlight = 2;
+            if (ArgIndex + 1 < Argc && Argv[ArgIndex + 1][0] != '-') FramesInFlight = (u32)atoi(Argv[++ArgIndex]);
+        }
+        else if (!strcmp(Argv[ArgIndex], "--bench-jobs"))
+        {
+            BenchmarkJobs = 4000000;
+            if (ArgIndex + 1 < Argc && Argv[ArgIndex + 1][0] != '-') BenchmarkJobs = (u32)atoi(Argv[++ArgIndex]);
         }
     }
-}
 
-internal void DrawMovingRects(moving_rect* Rects, s32 RectCount)
-{
-    for (s32 i = 0; i < RectCount; i++)
-    {
-        DrawPoint(
-            (s32)(Rects[i].Position.x * 32.0f),
-            (s32)(Rects[i].Position.y * 32.0f),
-            color{
-                (u8)(Rects[i].Color.r * 255.0f),
-                (u8)(Rects[i].Color.g * 255.0f),
-                (u8)(Rects[i].Color.b * 255.0f),
-                (u8)(Rects[i].Color.a * 255.0f)
-            }
-        );
+    if (BenchmarkJobs)
+    {
+        RunJobScalingBenchmark(BenchmarkJobs, ChunkSize);
+        return 0;
     }
-}
 
+    if (BenchmarkPolygons)
+    {
+        RunPolygonBenchmark();
+        return 0;
+    }
 
+    if (BenchmarkCurves)
+    {
+        RunCurveBenchmark();
+        return 0;
+    }
 
-int main(int Argc, char* Argv)
-{
-    srand(time(NULL));
+    InitJobSystem(&JobSystem, ThreadCount, ChunkSize);
+
+    if (BenchmarkSpatialHash)
+    {
+        RunSpatialHashBenchmark(100000 / (WindowWidth / 32.0f * WindowHeight / 32.0f), 0.25f);
+        ShutdownJobSystem(&JobSystem);
+        return 0;
+    }
 
     GLFWwindow* Window;
 
-    if (!glfwInit()) return -1;
+    if (!glfwInit())
+    {
+        ShutdownJobSystem(&JobSystem);
+        return -1;
+    }
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
 
     Window = glfwCreateWindow(WindowWidth, WindowHeight, "Batch Renderer 2D - OpenGL 3.3", NULL, NULL);
 
     if (!Window)
     {
+        ShutdownJobSystem(&JobSystem);
         glfwTerminate();
         return -1;
     }
@@ -154,34 +260,134 @@ int main(int Argc, char* Argv)
         MouseY = (s32)PosY;
     });
 
-    InitRenderer(WindowWidth, WindowHeight);
+    InitRenderer(WindowWidth, WindowHeight, glfwGetProcAddress);
 
-    s32 MovingRectsCount = 1000;
-    moving_rect *MovingRects = (moving_rect*)malloc(sizeof *MovingRects * MovingRectsCount);
+    if (BenchmarkFill)
+    {
+        RunFillBenchmark(BenchmarkFill);
+        ShutdownJobSystem(&JobSystem);
+        glfwTerminate();
+        return 0;
+    }
 
-    for (s32 i = 0; i < MovingRectsCount; i++)
+    particle_system Particles = {};
+    gpu_particle_system GpuParticleSystem = {};
+
+    if (GpuParticles)
+    {
+        InitGpuParticleSystem(&GpuParticleSystem, ParticleCount, WindowWidth / 32.0f, WindowHeight / 32.0f);
+    }
+    else
     {
-        f32 SignX = GenerateRandomNumber();
-        f32 SignY = GenerateRandomNumber();
-        SignX = (SignX > 0.5f) ? SignX = 1.0f : SignX = -1.0f;
-        SignY = (SignY > 0.5f) ? SignY = 1.0f : SignY = -1.0f;
+        InitParticleSystem(&Particles, ParticleCount, WindowWidth / 32.0f, WindowHeight / 32.0f);
+    }
 
-        f32 RandX = GenerateRandomNumber() * SignX;
-        f32 RandY = GenerateRandomNumber() * SignY;
-        MovingRects[i].Dir = glm::normalize(glm::vec2(RandX, RandY));
+    // Agents keep at least one particle scale apart
+    spatial_hash SpatialHash = {};
+    f32 SeparationRadius = 0.25f;
+    if (Separation && !GpuParticles)
+    {
+        InitSpatialHash(&SpatialHash, WindowWidth / 32.0f, WindowHeight / 32.0f, SeparationRadius, ParticleCount);
+    }
 
-        MovingRects[i].Position.x = GenerateRandomNumber() * (WindowWidth / 32.0f);
-        MovingRects[i].Position.y = GenerateRandomNumber() * (WindowHeight / 32.0f);
-        MovingRects[i].Color = glm::vec4(
-            glm::clamp(GenerateRandomNumber(), 0.7f, 1.0f),
-            glm::clamp(GenerateRandomNumber(), 0.7f, 1.0f),
-            glm::clamp(GenerateRandomNumber(), 0.7f, 1.0f),
-            1.0f);
-        MovingRects[i].Scale = 0.25f;
-        MovingRects[i].Speed = 10.0f;
+    // GPU particles issue GL calls from the game loop and draw outside the
+    // depth passes
+    if (GpuParticles && FramesInFlight)
+    {
+        printf("--gpu-particles runs without the render thread\n");
+        FramesInFlight = 0;
+    }
+    if (GpuParticles && DepthPasses)
+    {
+        printf("--gpu-particles runs without --depth\n");
+        DepthPasses = false;
     }
 
     texture Texture = LoadTexture("sprite.png");
+    SetDepthPasses(DepthPasses);
+
+    // Labels are built once; drawing them each frame hits the layout cache
+    font* Font = 0;
+    char (*Labels)[20] = 0;
+    if (FontPath)
+    {
+        InitTextSystem();
+        Font = SdfFont ? LoadSdfFont(FontPath, 32.0f) : LoadFont(FontPath, 16.0f);
+        Labels = (char (*)[20])malloc(sizeof(*Labels) * (LabelCount ? LabelCount : 1));
+        for (u32 i = 0; i < LabelCount; i++) snprintf(Labels[i], sizeof(*Labels), "Agent %u", i);
+    }
+
+    // The sprite texture is a 2x2 sheet; every unit starts at a random
+    // point of the loop and plays at its own speed
+    sprite_sheet Sheet = {};
+    animator_set Animators = {};
+    if (SpriteCount)
+    {
+        InitSpriteSheet(&Sheet, &Texture, Texture.Width / 2, Texture.Height / 2);
+        s32 Walk = AddAnimationClip(&Sheet, 0, 4, 8.0f, true);
+        InitAnimatorSet(&Animators, &Sheet, SpriteCount);
+
+        for (u32 i = 0; i < SpriteCount; i++)
+        {
+            s32 Index = AddAnimator(&Animators, Walk, (f32)(rand() % WindowWidth), (f32)(rand() % WindowHeight), COLOR_WHITE);
+            PlayClip(&Animators, Index, Walk, 0.5f + RandomUnit());
+            Animators.Time[Index] = RandomUnit() * 4.0f;
+        }
+    }
+
+    // Static overlays, tessellated once and then drawn from the cache
+    vec2* Polygons = (vec2*)malloc(sizeof(vec2) * 16 * (PolygonCount ? PolygonCount : 1));
+    for (u32 i = 0; i < PolygonCount; i++)
+    {
+        MakeStarPolygon(Polygons + i * 16, 16, vec2(rand() % WindowWidth, rand() % WindowHeight), 24.0f);
+    }
+
+    // Center and radius of each shape; every one is an SDF instance, so
+    // circles, rings and rounded rects together cost one draw call
+    vec3* Circles = (vec3*)malloc(sizeof(vec3) * (CircleCount ? CircleCount : 1));
+    color* CircleColors = (color*)malloc(sizeof(color) * (CircleCount ? CircleCount : 1));
+    for (u32 i = 0; i < CircleCount; i++)
+    {
+        Circles[i] = vec3(rand() % WindowWidth, rand() % WindowHeight, 2.0f + RandomUnit() * 14.0f);
+        CircleColors[i] = color{ (u8)rand(), (u8)rand(), (u8)rand(), 200 };
+    }
+
+    // Cubic curves flattened every frame, four control points each
+    vec2* Curves = (vec2*)malloc(sizeof(vec2) * 4 * (CurveCount ? CurveCount : 1));
+    for (u32 i = 0; i < CurveCount * 4; i++)
+    {
+        Curves[i] = vec2(rand() % WindowWidth, rand() % WindowHeight);
+    }
+
+    // Nine-slice panels skinned with the whole sprite texture. Some are
+    // smaller than their two borders, which then shrink to fit.
+    borders PanelBorders = { Texture.Width / 8, Texture.Height / 8, Texture.Width / 8, Texture.Height / 8 };
+    rect PanelSrc = { 0, 0, Texture.Width, Texture.Height };
+    rect* Panels = (rect*)malloc(sizeof(rect) * (PanelCount ? PanelCount : 1));
+    color* PanelColors = (color*)malloc(sizeof(color) * (PanelCount ? PanelCount : 1));
+    for (u32 i = 0; i < PanelCount; i++)
+    {
+        s32 Width = 4 + rand() % 200;
+        s32 Height = 4 + rand() % 120;
+        Panels[i] = { rand() % WindowWidth - Width / 2, rand() % WindowHeight - Height / 2, Width, Height };
+        PanelColors[i] = color{ (u8)(128 + rand() % 128), (u8)(128 + rand() % 128), (u8)(128 + rand() % 128), 255 };
+    }
+
+    // The chart is drawn into its layer once and composited every frame.
+    // Layers are redrawn on the GL thread, so not with the render thread.
+    rect ChartBounds = { WindowWidth - 520, 20, 500, 300 };
+    cached_layer* ChartLayer = 0;
+    if (Chart && LayerCache && !FramesInFlight) ChartLayer = CreateCachedLayer(ChartBounds);
+
+    // The render thread takes over the GL context from here on
+    if (FramesInFlight)
+    {
+        glfwMakeContextCurrent(NULL);
+        StartRenderThread(FramesInFlight,
+            [](void* User) { glfwMakeContextCurrent((GLFWwindow*)User); },
+            [](void* User) { glfwSwapBuffers((GLFWwindow*)User); },
+            Window);
+    }
 
     f64 LastTime = glfwGetTime();
     f64 Timer = 0;
@@ -201,29 +407,183 @@ int main(int Argc, char* Argv)
         if (Timer > 1.0f)
         {
             FramesPerSecond /= NumFrames;
-            printf("%d\n", FramesPerSecond);
+            printf("%d fps, %.1fM particles/s (%s)\n", FramesPerSecond,
+                (f64)ParticleCount * FramesPerSecond / 1e6, GpuParticles ? "gpu" : "cpu");
+
+            render_stats Stats = TakeRenderStats();
+            if (Stats.Frames)
+            {
+                printf("  per frame: %u draw calls, %u vertices, %u program binds, %u texture binds, %u blend switches, %u scissor changes, %.2fM fragments\n",
+                    Stats.DrawCalls / Stats.Frames, Stats.Vertices / Stats.Frames,
+                    Stats.ProgramBinds / Stats.Frames, Stats.TextureBinds / Stats.Frames,
+                    Stats.BlendSwitches / Stats.Frames, Stats.ScissorChanges / Stats.Frames,
+                    (f64)Stats.SamplesPassed / Stats.Frames / 1e6);
+            }
+
+            tessellation_stats Tessellation = TakeTessellationStats();
+            if (Tessellation.Hits + Tessellation.Misses)
+            {
+                printf("  polygons: %u cache hits, %u tessellated at %.1f Mpts/s\n", Tessellation.Hits,
+                    Tessellation.Misses, Tessellation.Seconds > 0.0 ? Tessellation.Points / Tessellation.Seconds / 1e6 : 0.0);
+            }
+
+            if (Font)
+            {
+                printf("  text: %u layout hits, %u misses, %u atlas evictions\n",
+                    TextSystem.LayoutHits, TextSystem.LayoutMisses, TextSystem.Atlas.Evictions);
+                TextSystem.LayoutHits = 0;
+                TextSystem.LayoutMisses = 0;
+            }
             Timer = 0;
             NumFrames = 0;
             FramesPerSecond = 0;
         }
 
-        UpdateMovingRects(MovingRects, MovingRectsCount, DeltaTime);
-                
+        particle_update Update = {};
+        Update.DeltaTime = (f32)DeltaTime;
+        Update.WorldWidth = WindowWidth / 32.0f;
+        Update.WorldHeight = WindowHeight / 32.0f;
+        Update.MouseX = MouseX / 32.0f;
+        Update.MouseY = MouseY / 32.0f;
+        Update.RepelRadius = 2.0f;
+
+        if (SpatialHash.Capacity)
+        {
+            if (!BuildSpatialHash(&SpatialHash, Particles.PositionX, Particles.PositionY, Particles.Count, &JobSystem))
+            {
+                GrowSpatialHash(&SpatialHash, Particles.Count);
+                BuildSpatialHash(&SpatialHash, Particles.PositionX, Particles.PositionY, Particles.Count, &JobSystem);
+            }
+            SeparateParticles(&Particles, &SpatialHash, SeparationRadius, 0.5f, &JobSystem);
+        }
+
+        if (!GpuParticles) UpdateParticles(&Particles, Update, &JobSystem);
+
         BeginFrame();
         ClearScreen(COLOR_BLACK);
 
+        // Worst case for overdraw: opaque full-screen layers drawn bottom
+        // up, so without depth passes every layer shades every pixel
+        if (OverdrawLayers)
+        {
+            SetBlendMode(BLEND_OPAQUE);
+            for (u32 Layer = 0; Layer < OverdrawLayers; Layer++)
+            {
+                SetDrawLayer(-(s32)OverdrawLayers + (s32)Layer);
+                u8 Shade = (u8)(Layer * 255 / OverdrawLayers);
+                DrawRect(0, 0, WindowWidth, WindowHeight, color{ Shade, 0, (u8)(255 - Shade), 255 });
+            }
+            SetBlendMode(BLEND_ALPHA);
+            SetDrawLayer(0);
+        }
+
         rect SrcRect = { 0, 0, Texture.Width / 2, Texture.Height / 2 };
         rect DstRect = { 32, 32, 32, 32 };
         DrawTexture(&Texture, SrcRect, DstRect, COLOR_WHITE);
         //DrawRect(0, 0, 32, 32, COLOR_WHITE);
 
-        //DrawMovingRects(MovingRects, MovingRectsCount);
+        if (GpuParticles)
+        {
+            UpdateGpuParticles(&GpuParticleSystem, Update);
+            DrawGpuParticles(&GpuParticleSystem, 32.0f);
+        }
+        else
+        {
+            DrawParticles(&Particles, 32.0f);
+        }
+
+        if (SpriteCount)
+        {
+            UpdateAnimators(&Animators, (f32)DeltaTime, &JobSystem);
+            DrawAnimators(&Animators, 0.5f);
+        }
+
+        if (ChartLayer)
+        {
+            if (BeginCachedLayer(ChartLayer))
+            {
+                DrawChartBackground(ChartBounds);
+                EndCachedLayer(ChartLayer);
+            }
+            DrawCachedLayer(ChartLayer);
+        }
+        else if (Chart)
+        {
+            DrawChartBackground(ChartBounds);
+        }
+
+        for (u32 i = 0; i < CircleCount; i++)
+        {
+            vec3 Circle = Circles[i];
+            switch (i % 4)
+            {
+                case 2: DrawRing(Circle.x, Circle.y, Circle.z, 2.0f, CircleColors[i]); break;
+                case 3: DrawRoundedRect(Circle.x - Circle.z, Circle.y - Circle.z, Circle.z * 2.0f, Circle.z * 1.5f, Circle.z * 0.4f, CircleColors[i]); break;
+                default: DrawCircle(Circle.x, Circle.y, Circle.z, CircleColors[i]); break;
+            }
+        }
+
+        if (ScrollPanel)
+        {
+            DrawScrollingPanel(rect{ 40, 80, 420, 300 }, (f32)glfwGetTime() * 40.0f, &Texture, Font);
+        }
+
+        if (PanelCount)
+        {
+            DrawNineSlices(&Texture, PanelSrc, PanelBorders, Panels, PanelColors, PanelCount);
+        }
+
+        if (CurveCount)
+        {
+            DrawCubicBeziers(Curves, CurveCount, color{ 255, 200, 80, 255 });
+
+            // A spinner arc, flattened again every frame as it turns
+            f32 Angle = (f32)glfwGetTime() * 4.0f;
+            DrawArc(vec2(WindowWidth - 60.0f, WindowHeight - 60.0f), 32.0f, Angle, Angle + 4.5f, COLOR_WHITE, 6.0f);
+        }
+
+        for (u32 i = 0; i < PolygonCount; i++)
+        {
+            DrawPolygon(Polygons + i * 16, 16, color{ 40, 120, 200, 255 });
+        }
+
+        if (Font)
+        {
+            // SDF labels zoom in and out without touching the atlas
+            f32 Zoom = 1.0f + 0.5f * sinf((f32)glfwGetTime());
+            for (u32 i = 0; i < LabelCount; i++)
+            {
+                f32 X = (f32)(i % 16 * 80);
+                f32 Y = (f32)(i / 16 % 36 * 20);
+                if (SdfFont) DrawTextScaled(Font, Labels[i], X * Zoom, Y * Zoom, 16.0f * Zoom, 0.0f, COLOR_WHITE);
+                else DrawText(Font, Labels[i], X, Y, COLOR_WHITE);
+            }
+        }
         EndFrame();
         
-        glfwSwapBuffers(Window);
+        if (!FramesInFlight) glfwSwapBuffers(Window);
         glfwPollEvents();
     }
 
+    StopRenderThread();
+    if (ChartLayer) FreeCachedLayer(ChartLayer);
+    if (Font) FreeFont(Font);
+    free(Labels);
+    free(Polygons);
+    free(Circles);
+    free(Curves);
+    free(Panels);
+    free(PanelColors);
+    free(CircleColors);
+    if (SpriteCount)
+    {
+        FreeAnimatorSet(&Animators);
+        FreeSpriteSheet(&Sheet);
+    }
+    if (SpatialHash.Capacity) FreeSpatialHash(&SpatialHash);
+    if (GpuParticles) FreeGpuParticleSystem(&GpuParticleSystem);
+    else FreeParticleSystem(&Particles);
+    ShutdownJobSystem(&JobSystem);
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,374 @@
+/*
+================================
+Particle System
+================================
+*/
+
+internal f32 RandomUnit()
+{
+    return (f32)rand() / RAND_MAX;
+}
+
+global void InitParticleSystem(particle_system* System, u32 Count, f32 WorldWidth, f32 WorldHeight)
+{
+    u32 Capacity = (Count + PARTICLE_LANES - 1) & ~(PARTICLE_LANES - 1);
+
+    *System = {};
+    System->Count = Count;
+    System->Capacity = Capacity;
+    System->PositionX = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    System->PositionY = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    System->DirX = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    System->DirY = (f32*)_mm_malloc(sizeof(f32) * Capacity, 16);
+    System->Colors = (color*)_mm_malloc(sizeof(color) * Capacity, 16);
+    System->Scale = 0.25f;
+    System->Speed = 10.0f;
+
+    for (u32 i = 0; i < Capacity; i++)
+    {
+        f32 SignX = (RandomUnit() > 0.5f) ? 1.0f : -1.0f;
+        f32 SignY = (RandomUnit() > 0.5f) ? 1.0f : -1.0f;
+        vec2 Dir = glm::normalize(vec2(RandomUnit() * SignX, RandomUnit() * SignY));
+
+        System->PositionX[i] = RandomUnit() * WorldWidth;
+        System->PositionY[i] = RandomUnit() * WorldHeight;
+        System->DirX[i] = Dir.x;
+        System->DirY[i] = Dir.y;
+        System->Colors[i] = color{
+            (u8)(glm::clamp(RandomUnit(), 0.7f, 1.0f) * 255.0f),
+            (u8)(glm::clamp(RandomUnit(), 0.7f, 1.0f) * 255.0f),
+            (u8)(glm::clamp(RandomUnit(), 0.7f, 1.0f) * 255.0f),
+            255
+        };
+    }
+}
+
+global void FreeParticleSystem(particle_system* System)
+{
+    _mm_free(System->PositionX);
+    _mm_free(System->PositionY);
+    _mm_free(System->DirX);
+    _mm_free(System->DirY);
+    _mm_free(System->Colors);
+    *System = {};
+}
+
+struct particle_job
+{
+    particle_system* System;
+    particle_update Update;
+};
+
+// Integrates, applies the cursor repulsion and bounces off the world bounds
+// for PARTICLE_LANES particles at a time. Every decision is a lane mask, so
+// there are no branches per particle. Start and End are lane groups.
+internal void UpdateParticlesJob(void* Data, u32 Start, u32 End)
+{
+    particle_job* Job = (particle_job*)Data;
+    particle_system* System = Job->System;
+    const particle_update& Update = Job->Update;
+
+    __m128 Step = _mm_set1_ps(System->Speed * Update.DeltaTime);
+    __m128 MouseX = _mm_set1_ps(Update.MouseX);
+    __m128 MouseY = _mm_set1_ps(Update.MouseY);
+    __m128 RepelRadius2 = _mm_set1_ps(Update.RepelRadius * Update.RepelRadius);
+    __m128 MaxX = _mm_set1_ps(Update.WorldWidth - System->Scale);
+    __m128 MaxY = _mm_set1_ps(Update.WorldHeight - System->Scale);
+    __m128 Zero = _mm_setzero_ps();
+    __m128 SignBit = _mm_set1_ps(-0.0f);
+
+    for (u32 Group = Start; Group < End; Group++)
+    {
+        u32 i = Group * PARTICLE_LANES;
+
+        __m128 PosX = _mm_load_ps(System->PositionX + i);
+        __m128 PosY = _mm_load_ps(System->PositionY + i);
+        __m128 DirX = _mm_load_ps(System->DirX + i);
+        __m128 DirY = _mm_load_ps(System->DirY + i);
+
+        PosX = _mm_add_ps(PosX, _mm_mul_ps(DirX, Step));
+        PosY = _mm_add_ps(PosY, _mm_mul_ps(DirY, Step));
+
+        // Point away from the cursor when inside the radius
+        __m128 AwayX = _mm_sub_ps(PosX, MouseX);
+        __m128 AwayY = _mm_sub_ps(PosY, MouseY);
+        __m128 Distance2 = _mm_add_ps(_mm_mul_ps(AwayX, AwayX), _mm_mul_ps(AwayY, AwayY));
+        __m128 Repel = _mm_and_ps(_mm_cmplt_ps(Distance2, RepelRadius2), _mm_cmpgt_ps(Distance2, Zero));
+        __m128 InvLength = _mm_rsqrt_ps(Distance2);
+        DirX = _mm_or_ps(_mm_and_ps(Repel, _mm_mul_ps(AwayX, InvLength)), _mm_andnot_ps(Repel, DirX));
+        DirY = _mm_or_ps(_mm_and_ps(Repel, _mm_mul_ps(AwayY, InvLength)), _mm_andnot_ps(Repel, DirY));
+
+        // Clamp into the bounds and flip the direction of lanes that hit a wall
+        __m128 HitX = _mm_or_ps(_mm_cmplt_ps(PosX, Zero), _mm_cmpgt_ps(PosX, MaxX));
+        __m128 HitY = _mm_or_ps(_mm_cmplt_ps(PosY, Zero), _mm_cmpgt_ps(PosY, MaxY));
+        PosX = _mm_min_ps(_mm_max_ps(PosX, Zero), MaxX);
+        PosY = _mm_min_ps(_mm_max_ps(PosY, Zero), MaxY);
+        DirX = _mm_xor_ps(DirX, _mm_and_ps(HitX, SignBit));
+        DirY = _mm_xor_ps(DirY, _mm_and_ps(HitY, SignBit));
+
+        _mm_store_ps(System->PositionX + i, PosX);
+        _mm_store_ps(System->PositionY + i, PosY);
+        _mm_store_ps(System->DirX + i, DirX);
+        _mm_store_ps(System->DirY + i, DirY);
+    }
+}
+
+// Pass a job system to spread the update over its threads, or 0 to run it
+// on the calling thread.
+global void UpdateParticles(particle_system* System, const particle_update& Update, job_system* Jobs)
+{
+    particle_job Job = {};
+    Job.System = System;
+    Job.Update = Update;
+
+    u32 GroupCount = System->Capacity / PARTICLE_LANES;
+
+    if (Jobs)
+    {
+        ParallelFor(Jobs, GroupCount, UpdateParticlesJob, &Job, Jobs->ChunkSize / PARTICLE_LANES);
+    }
+    else
+    {
+        UpdateParticlesJob(&Job, 0, GroupCount);
+    }
+}
+
+// WorldToPixels converts the world-space positions into screen space.
+global void DrawParticles(particle_system* System, f32 WorldToPixels)
+{
+    DrawPointSources(MakeVertexSource(System->PositionX), MakeVertexSource(System->PositionY),
+        MakeVertexSource(System->Colors), System->Count, WorldToPixels);
+}
+
+/*
+================================
+GPU Particle System
+================================
+*/
+
+internal u32 CreateParticleUpdateProgram()
+{
+    const char* VertexShaderCode = GLSL(
+        in vec2 InPosition;
+        in vec2 InDir;
+
+        out vec2 OutPosition;
+        out vec2 OutDir;
+
+        uniform float Step;
+        uniform vec2 Mouse;
+        uniform float RepelRadius;
+        uniform vec2 MaxPosition;
+
+        void main()
+        {
+            vec2 Position = InPosition + InDir * Step;
+            vec2 Dir = InDir;
+
+            vec2 Away = Position - Mouse;
+            float Distance2 = dot(Away, Away);
+            if (Distance2 < RepelRadius * RepelRadius && Distance2 > 0.0)
+            {
+                Dir = Away * inversesqrt(Distance2);
+            }
+
+            vec2 Hit = vec2(lessThan(Position, vec2(0.0))) + vec2(greaterThan(Position, MaxPosition));
+            OutDir = mix(Dir, -Dir, Hit);
+            OutPosition = clamp(Position, vec2(0.0), MaxPosition);
+        }
+    );
+
+    u32 VertexShader = CreateShader(VertexShaderCode, GL_VERTEX_SHADER);
+    if (!VertexShader) return 0;
+
+    u32 Program = glCreateProgram();
+    glAttachShader(Program, VertexShader);
+    glBindAttribLocation(Program, 0, "InPosition");
+    glBindAttribLocation(Program, 1, "InDir");
+
+    // Varyings have to be declared before linking
+    const char* Varyings[] = { "OutPosition", "OutDir" };
+    glTransformFeedbackVaryings(Program, 2, Varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(Program);
+    glDeleteShader(VertexShader);
+
+    GLint Linked = GL_FALSE;
+    glGetProgramiv(Program, GL_LINK_STATUS, &Linked);
+
+    if (!Linked)
+    {
+        char Message[4096];
+        s32 Ignore;
+        glGetProgramInfoLog(Program, 4096, &Ignore, Message);
+        printf("%s\n", Message);
+        glDeleteProgram(Program);
+        return 0;
+    }
+    return Program;
+}
+
+internal u32 CreateParticleDrawProgram()
+{
+    const char* VertexShaderCode = GLSL(
+        in vec2 VertPosition;
+        in vec4 VertColor;
+
+        out vec4 Color;
+
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform float WorldToPixels;
+        uniform float Depth;
+
+        void main()
+        {
+            gl_Position = Projection * ModelView * vec4(VertPosition * WorldToPixels, Depth, 1.0);
+            Color = VertColor;
+        }
+    );
+
+    const char* FragmentShaderCode = GLSL(
+        in vec4 Color;
+        out vec4 FragColor;
+
+        void main()
+        {
+            FragColor = Color;
+        }
+    );
+
+    return CreateCachedProgram(VertexShaderCode, FragmentShaderCode);
+}
+
+// Starts from the same random distribution as InitParticleSystem.
+global void InitGpuParticleSystem(gpu_particle_system* System, u32 Count, f32 WorldWidth, f32 WorldHeight)
+{
+    particle_system Initial;
+    InitParticleSystem(&Initial, Count, WorldWidth, WorldHeight);
+
+    f32* State = (f32*)malloc(sizeof(f32) * 4 * Count);
+    for (u32 i = 0; i < Count; i++)
+    {
+        State[i * 4 + 0] = Initial.PositionX[i];
+        State[i * 4 + 1] = Initial.PositionY[i];
+        State[i * 4 + 2] = Initial.DirX[i];
+        State[i * 4 + 3] = Initial.DirY[i];
+    }
+
+    *System = {};
+    System->Count = Count;
+    System->Scale = Initial.Scale;
+    System->Speed = Initial.Speed;
+    System->UpdateProgram = CreateParticleUpdateProgram();
+    System->StepLocation = glGetUniformLocation(System->UpdateProgram, "Step");
+    System->MouseLocation = glGetUniformLocation(System->UpdateProgram, "Mouse");
+    System->RepelRadiusLocation = glGetUniformLocation(System->UpdateProgram, "RepelRadius");
+    System->MaxPositionLocation = glGetUniformLocation(System->UpdateProgram, "MaxPosition");
+    System->DrawProgram = CreateParticleDrawProgram();
+    System->ProjectionLocation = glGetUniformLocation(System->DrawProgram, "Projection");
+    System->ModelViewLocation = glGetUniformLocation(System->DrawProgram, "ModelView");
+    System->WorldToPixelsLocation = glGetUniformLocation(System->DrawProgram, "WorldToPixels");
+    System->DepthLocation = glGetUniformLocation(System->DrawProgram, "Depth");
+
+    glGenBuffers(2, System->Vbos);
+    glGenBuffers(1, &System->ColorVbo);
+    glGenVertexArrays(2, System->UpdateVaos);
+    glGenVertexArrays(2, System->DrawVaos);
+
+    glBindBuffer(GL_ARRAY_BUFFER, System->ColorVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(color) * Count, Initial.Colors, GL_STATIC_DRAW);
+
+    for (s32 i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, System->Vbos[i]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 4 * Count, State, GL_DYNAMIC_COPY);
+
+        BindVertexArray(System->UpdateVaos[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(f32) * 4, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(f32) * 4, (void*)(sizeof(f32) * 2));
+
+        BindVertexArray(System->DrawVaos[i]);
+        glEnableVertexAttribArray(ATTRIB_POSITION);
+        glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(f32) * 4, (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, System->ColorVbo);
+        glEnableVertexAttribArray(ATTRIB_COLOR);
+        glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)0);
+    }
+
+    BindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    free(State);
+    FreeParticleSystem(&Initial);
+}
+
+global void FreeGpuParticleSystem(gpu_particle_system* System)
+{
+    glDeleteVertexArrays(2, System->UpdateVaos);
+    glDeleteVertexArrays(2, System->DrawVaos);
+    glDeleteBuffers(2, System->Vbos);
+    glDeleteBuffers(1, &System->ColorVbo);
+    glDeleteProgram(System->UpdateProgram);
+    glDeleteProgram(System->DrawProgram);
+    *System = {};
+}
+
+global void UpdateGpuParticles(gpu_particle_system* System, const particle_update& Update)
+{
+    u32 Next = 1 - System->Current;
+
+    BindProgram(System->UpdateProgram);
+    glUniform1f(System->StepLocation, System->Speed * Update.DeltaTime);
+    glUniform2f(System->MouseLocation, Update.MouseX, Update.MouseY);
+    glUniform1f(System->RepelRadiusLocation, Update.RepelRadius);
+    glUniform2f(System->MaxPositionLocation,
+        Update.WorldWidth - System->Scale, Update.WorldHeight - System->Scale);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    BindVertexArray(System->UpdateVaos[System->Current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, System->Vbos[Next]);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, System->Count);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    System->Current = Next;
+}
+
+// Draws immediately rather than through a batch, so call it between
+// BeginFrame and EndFrame on the thread that owns the GL context. Whatever
+// is still batched is drawn first to keep the order. The particles never
+// reach the CPU, so they cannot be recorded into a render context or a
+// depth pass; with either active this draws nothing and returns false.
+global bool DrawGpuParticles(gpu_particle_system* System, f32 WorldToPixels)
+{
+    if (ActiveContext || RenderState.DepthPasses) return false;
+
+    batch_key Key = {};
+    if (!ScissorBatchKey(&Key)) return true;
+
+    // The transform feedback buffer is drawn directly, bypassing the
+    // batches, so anything still queued in them has to reach GL first or
+    // it would land on top of the particles
+    FlushRenderBatches();
+
+    BindBlendMode(RenderState.DrawState.Blend);
+    BindScissor(Key.Scissor);
+    BindProgram(System->DrawProgram);
+    glUniformMatrix4fv(System->ProjectionLocation, 1, 0, &RenderState.Projection[0][0]);
+    glUniformMatrix4fv(System->ModelViewLocation, 1, 0, &RenderState.ModelView[0][0]);
+    glUniform1f(System->WorldToPixelsLocation, WorldToPixels);
+    glUniform1f(System->DepthLocation, RenderState.DrawState.Depth);
+
+    BindVertexArray(System->DrawVaos[System->Current]);
+    glDrawArrays(GL_POINTS, 0, System->Count);
+
+    RenderState.Stats.DrawCalls++;
+    RenderState.Stats.Vertices += System->Count;
+    return true;
+}
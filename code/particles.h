@@ -0,0 +1,57 @@
+#pragma once
+
+#define PARTICLE_LANES 4
+
+// Structure-of-arrays particle storage. Arrays are 16-byte aligned and
+// padded to a multiple of PARTICLE_LANES so the update never needs a scalar
+// tail loop. Scale and speed are shared by every particle.
+struct particle_system
+{
+    u32 Count;
+    u32 Capacity;
+    f32* PositionX;
+    f32* PositionY;
+    f32* DirX;
+    f32* DirY;
+    color* Colors;
+    f32 Scale;
+    f32 Speed;
+};
+
+// Positions are in world units; the cursor pushes particles within
+// RepelRadius straight away from it.
+struct particle_update
+{
+    f32 DeltaTime;
+    f32 WorldWidth;
+    f32 WorldHeight;
+    f32 MouseX;
+    f32 MouseY;
+    f32 RepelRadius;
+};
+
+// Same simulation as particle_system, run by a transform feedback vertex
+// shader. Each Vbos[i] holds interleaved position.xy and direction.xy; the
+// update reads Vbos[Current] and writes the other one, and drawing reads the
+// result directly, so particle data never travels back to the CPU.
+struct gpu_particle_system
+{
+    u32 Count;
+    u32 Current;
+    u32 Vbos[2];
+    u32 ColorVbo;
+    u32 UpdateVaos[2];
+    u32 DrawVaos[2];
+    u32 UpdateProgram;
+    s32 StepLocation;
+    s32 MouseLocation;
+    s32 RepelRadiusLocation;
+    s32 MaxPositionLocation;
+    u32 DrawProgram;
+    s32 ProjectionLocation;
+    s32 ModelViewLocation;
+    s32 WorldToPixelsLocation;
+    s32 DepthLocation;
+    f32 Scale;
+    f32 Speed;
+};
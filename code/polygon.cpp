@@ -0,0 +1,273 @@
+global tessellation_cache TessellationCache;
+global thread_local u32* TessellationScratch;
+global thread_local u32 TessellationScratchCapacity;
+
+/*
+================================
+Ear Clipping
+================================
+*/
+
+internal f32 Cross(vec2 A, vec2 B, vec2 C)
+{
+    return (B.x - A.x) * (C.y - A.y) - (B.y - A.y) * (C.x - A.x);
+}
+
+// Inclusive, so a point on an edge blocks the ear as well.
+internal bool PointInTriangle(vec2 P, vec2 A, vec2 B, vec2 C)
+{
+    return Cross(A, B, P) >= 0.0f && Cross(B, C, P) >= 0.0f && Cross(C, A, P) >= 0.0f;
+}
+
+internal bool IsReflex(ear_clipper* Clipper, u32 Vertex)
+{
+    const vec2* Points = Clipper->Points;
+    return Cross(Points[Clipper->Previous[Vertex]], Points[Vertex], Points[Clipper->Next[Vertex]]) <= 0.0f;
+}
+
+internal s32 ClipperCell(f32 Value, f32 Min, f32 InvCellSize, s32 CellCount)
+{
+    return glm::clamp((s32)((Value - Min) * InvCellSize), 0, CellCount - 1);
+}
+
+// Only reflex vertices can lie inside a convex corner's triangle, and only
+// those in the grid cells under the triangle need to be tested.
+internal bool IsEar(ear_clipper* Clipper, u32 Prev, u32 Current, u32 Following)
+{
+    const vec2* Points = Clipper->Points;
+    vec2 A = Points[Prev];
+    vec2 B = Points[Current];
+    vec2 C = Points[Following];
+
+    if (Cross(A, B, C) <= 0.0f) return false;
+
+    s32 X0 = ClipperCell(glm::min(A.x, glm::min(B.x, C.x)), Clipper->Min.x, Clipper->InvCellSize.x, Clipper->Columns);
+    s32 X1 = ClipperCell(glm::max(A.x, glm::max(B.x, C.x)), Clipper->Min.x, Clipper->InvCellSize.x, Clipper->Columns);
+    s32 Y0 = ClipperCell(glm::min(A.y, glm::min(B.y, C.y)), Clipper->Min.y, Clipper->InvCellSize.y, Clipper->Rows);
+    s32 Y1 = ClipperCell(glm::max(A.y, glm::max(B.y, C.y)), Clipper->Min.y, Clipper->InvCellSize.y, Clipper->Rows);
+
+    for (s32 Y = Y0; Y <= Y1; Y++)
+    {
+        for (s32 X = X0; X <= X1; X++)
+        {
+            u32 Cell = Y * Clipper->Columns + X;
+
+            for (u32 Item = Clipper->CellStart[Cell]; Item < Clipper->CellStart[Cell + 1]; Item++)
+            {
+                u32 Other = Clipper->CellItems[Item];
+                if (Clipper->Removed[Other] || Other == Prev || Other == Current || Other == Following) continue;
+
+                // Duplicated points where a polygon touches itself do not block
+                vec2 P = Points[Other];
+                if ((P.x == A.x && P.y == A.y) || (P.x == B.x && P.y == B.y) || (P.x == C.x && P.y == C.y)) continue;
+
+                if (IsReflex(Clipper, Other) && PointInTriangle(P, A, B, C)) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Writes 3 * (Count - 2) indices into Points, all triangles wound the same
+// way whatever the input winding. Works on any simple polygon, convex or
+// not. Self-intersecting input still produces Count - 2 triangles, but
+// some of them overlap.
+global void TriangulatePolygon(const vec2* Points, u32 Count, u32* Indices)
+{
+    // Links, removed flags and the grid; there are never more reflex
+    // vertices, and so grid cells, than points
+    u32 ScratchSize = Count * 5 + 2;
+    if (ScratchSize > TessellationScratchCapacity)
+    {
+        TessellationScratchCapacity = glm::max(ScratchSize, TessellationScratchCapacity * 2);
+        TessellationScratch = (u32*)realloc(TessellationScratch, sizeof(u32) * TessellationScratchCapacity);
+    }
+
+    ear_clipper Clipper = {};
+    Clipper.Points = Points;
+    Clipper.Next = TessellationScratch;
+    Clipper.Previous = TessellationScratch + Count;
+    Clipper.Removed = TessellationScratch + Count * 2;
+    Clipper.CellItems = TessellationScratch + Count * 3;
+    Clipper.CellStart = TessellationScratch + Count * 4;
+
+    f32 Area = 0.0f;
+    vec2 Min = Points[0];
+    vec2 Max = Points[0];
+
+    for (u32 i = 0; i < Count; i++)
+    {
+        u32 Prev = (i + Count - 1) % Count;
+        Clipper.Next[i] = (i + 1) % Count;
+        Clipper.Previous[i] = Prev;
+        Clipper.Removed[i] = 0;
+        Area += Points[Prev].x * Points[i].y - Points[i].x * Points[Prev].y;
+
+        Min = vec2(glm::min(Min.x, Points[i].x), glm::min(Min.y, Points[i].y));
+        Max = vec2(glm::max(Max.x, Points[i].x), glm::max(Max.y, Points[i].y));
+    }
+
+    // Walk the ring in counter-clockwise order so convex corners have a
+    // positive cross product
+    if (Area < 0.0f)
+    {
+        u32* Swap = Clipper.Next;
+        Clipper.Next = Clipper.Previous;
+        Clipper.Previous = Swap;
+    }
+
+    // Clipping ears only ever turns reflex vertices convex, so the grid
+    // built here covers every vertex that can block an ear later
+    u32 ReflexCount = 0;
+    for (u32 i = 0; i < Count; i++) ReflexCount += IsReflex(&Clipper, i);
+
+    s32 Side = glm::max((s32)sqrtf((f32)ReflexCount), 1);
+    Clipper.Min = Min;
+    Clipper.Columns = Side;
+    Clipper.Rows = Side;
+    Clipper.InvCellSize = vec2(Side / glm::max(Max.x - Min.x, 1e-6f), Side / glm::max(Max.y - Min.y, 1e-6f));
+
+    u32 CellCount = Side * Side;
+    u32* CellStart = Clipper.CellStart;
+    memset(CellStart, 0, sizeof(u32) * (CellCount + 1));
+
+    for (u32 i = 0; i < Count; i++)
+    {
+        if (!IsReflex(&Clipper, i)) continue;
+        s32 X = ClipperCell(Points[i].x, Min.x, Clipper.InvCellSize.x, Side);
+        s32 Y = ClipperCell(Points[i].y, Min.y, Clipper.InvCellSize.y, Side);
+        CellStart[Y * Side + X]++;
+    }
+
+    // Counts become cell ends, and filling moves them back to the starts
+    for (u32 Cell = 1; Cell < CellCount; Cell++) CellStart[Cell] += CellStart[Cell - 1];
+    CellStart[CellCount] = ReflexCount;
+
+    for (u32 i = Count; i-- > 0;)
+    {
+        if (!IsReflex(&Clipper, i)) continue;
+        s32 X = ClipperCell(Points[i].x, Min.x, Clipper.InvCellSize.x, Side);
+        s32 Y = ClipperCell(Points[i].y, Min.y, Clipper.InvCellSize.y, Side);
+        Clipper.CellItems[--CellStart[Y * Side + X]] = i;
+    }
+
+    u32 Remaining = Count;
+    u32 Current = 0;
+    u32 Stalled = 0;
+
+    while (Remaining > 3)
+    {
+        u32 Prev = Clipper.Previous[Current];
+        u32 Following = Clipper.Next[Current];
+
+        // A full lap without an ear means the rest is degenerate or self
+        // intersecting; clip anyway so the loop ends
+        if (IsEar(&Clipper, Prev, Current, Following) || Stalled > Remaining)
+        {
+            *Indices++ = Prev;
+            *Indices++ = Current;
+            *Indices++ = Following;
+
+            Clipper.Next[Prev] = Following;
+            Clipper.Previous[Following] = Prev;
+            Clipper.Removed[Current] = 1;
+            Remaining--;
+            Stalled = 0;
+            Current = Prev;
+        }
+        else
+        {
+            Current = Following;
+            Stalled++;
+        }
+    }
+
+    *Indices++ = Clipper.Previous[Current];
+    *Indices++ = Current;
+    *Indices++ = Clipper.Next[Current];
+}
+
+/*
+================================
+Polygon
+================================
+*/
+
+// Returns the totals since the previous call.
+global tessellation_stats TakeTessellationStats()
+{
+    std::lock_guard<std::mutex> Guard(TessellationCache.Lock);
+    tessellation_stats Result = TessellationCache.Stats;
+    TessellationCache.Stats = {};
+    return Result;
+}
+
+// Copies the polygon's triangles into Indices, offset by BaseVertex. On a
+// miss the polygon is tessellated outside the lock and then cached.
+internal void GetPolygonIndices(const vec2* Points, u32 Count, u32* Indices, u32 BaseVertex)
+{
+    tessellation_cache* Cache = &TessellationCache;
+    u32 IndexCount = (Count - 2) * 3;
+    u64 Hash = HashBytes(Points, sizeof(vec2) * Count);
+    tessellation_entry* Set = Cache->Entries + (Hash & (TESSELLATION_CACHE_SLOTS - 2));
+
+    {
+        std::lock_guard<std::mutex> Guard(Cache->Lock);
+        for (s32 Way = 0; Way < 2; Way++)
+        {
+            tessellation_entry* Entry = Set + Way;
+            if (Entry->Hash == Hash && Entry->PointCount == Count)
+            {
+                for (u32 i = 0; i < IndexCount; i++) Indices[i] = Entry->Indices[i] + BaseVertex;
+                Entry->LastUsed = ++Cache->Tick;
+                Cache->Stats.Hits++;
+                return;
+            }
+        }
+    }
+
+    f64 Start = GetWallClock();
+    TriangulatePolygon(Points, Count, Indices);
+    f64 Elapsed = GetWallClock() - Start;
+
+    std::lock_guard<std::mutex> Guard(Cache->Lock);
+    tessellation_entry* Entry = Set[0].LastUsed <= Set[1].LastUsed ? Set : Set + 1;
+
+    if (IndexCount > Entry->IndexCapacity)
+    {
+        Entry->Indices = (u32*)realloc(Entry->Indices, sizeof(u32) * IndexCount);
+        Entry->IndexCapacity = IndexCount;
+    }
+    memcpy(Entry->Indices, Indices, sizeof(u32) * IndexCount);
+    Entry->Hash = Hash;
+    Entry->LastUsed = ++Cache->Tick;
+    Entry->PointCount = Count;
+
+    for (u32 i = 0; i < IndexCount; i++) Indices[i] += BaseVertex;
+
+    Cache->Stats.Misses++;
+    Cache->Stats.Points += Count;
+    Cache->Stats.Seconds += Elapsed;
+}
+
+// Filled simple polygon, convex or concave, in either winding. Polygons
+// with more than POLYGON_MAX_POINTS points are not drawn.
+global void DrawPolygon(const vec2* Points, u32 Count, color Color)
+{
+    if (Count < 3 || Count > POLYGON_MAX_POINTS) return;
+
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipPointsKey(&Key, Points, Count, 0.0f)) return;
+    render_batch* RenderBatch = ReserveBatch(R_TRIANGLES, Key, Count, (Count - 2) * 3);
+    vertex_buffer* Buffer = &RenderBatch->Buffer;
+
+    GetPolygonIndices(Points, Count, Buffer->Indices + Buffer->ElementCount, Buffer->VertexCount);
+    Buffer->ElementCount += (Count - 2) * 3;
+
+    for (u32 i = 0; i < Count; i++)
+    {
+        vertex_input Vertex = { BatchPosition(Key, Points[i].x, Points[i].y), vec2(0.0f), Color };
+        PushVertex<R_TRIANGLES>(RenderBatch, Vertex);
+    }
+}
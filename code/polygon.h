@@ -0,0 +1,51 @@
+#pragma once
+
+#define TESSELLATION_CACHE_SLOTS 4096
+
+// A polygon needs Count - 2 triangles, and all of them go into one batch.
+#define POLYGON_MAX_POINTS (RENDER_BATCH_MAX_INDICES / 3 + 2)
+
+// Working state of one TriangulatePolygon call. Next and Previous link the
+// vertices still in the polygon; the grid holds the initially reflex ones.
+struct ear_clipper
+{
+    const vec2* Points;
+    u32* Next;
+    u32* Previous;
+    u32* Removed;
+    u32* CellStart;
+    u32* CellItems;
+    vec2 Min;
+    vec2 InvCellSize;
+    s32 Columns;
+    s32 Rows;
+};
+
+// Triangle indices of one polygon, keyed by a hash of its points.
+struct tessellation_entry
+{
+    u64 Hash;
+    u64 LastUsed;
+    u32 PointCount;
+    u32 IndexCapacity;
+    u32* Indices;
+};
+
+struct tessellation_stats
+{
+    u32 Hits;
+    u32 Misses;
+    u64 Points;
+    f64 Seconds;
+};
+
+// Two-way set associative cache of ear-clipping results. Static shapes are
+// drawn from the cache; a polygon whose points changed hashes differently
+// and is tessellated again. Tick orders the lookups for replacement.
+struct tessellation_cache
+{
+    tessellation_entry Entries[TESSELLATION_CACHE_SLOTS];
+    tessellation_stats Stats;
+    u64 Tick;
+    std::mutex Lock;
+};
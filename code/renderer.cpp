@@ -1,6 +1,11 @@
 #define GLSL(x) "#version 330 core\n" #x
 
 global render_state RenderState;
+global render_thread RenderThread;
+global thread_local render_context* ActiveContext;
+global thread_local render_context* DefaultContext;
+global thread_local color* ColorScratch;
+global thread_local u32 ColorScratchCapacity;
 
 /*
 ================================
@@ -8,54 +13,131 @@ Utils
 ================================
 */
 
-global vec4 ColorRangeZeroOne(color Color)
+global f64 GetWallClock()
 {
-    vec4 Result = vec4(Color.R, Color.G, Color.B, Color.A);
-    Result /= 255.0f;
+    using namespace std::chrono;
+    return duration<f64>(steady_clock::now().time_since_epoch()).count();
+}
+
+// FNV-1a, continued from Hash so several strings can be chained.
+global u64 HashString(const char* String, u64 Hash = 0xcbf29ce484222325ull)
+{
+    for (; *String; String++)
+    {
+        Hash ^= (u8)*String;
+        Hash *= 0x100000001b3ull;
+    }
+    return Hash;
+}
+
+global u64 HashBytes(const void* Data, u64 Size, u64 Hash = 0xcbf29ce484222325ull)
+{
+    const u8* Bytes = (const u8*)Data;
+    for (u64 i = 0; i < Size; i++)
+    {
+        Hash ^= Bytes[i];
+        Hash *= 0x100000001b3ull;
+    }
+    return Hash;
+}
+
+global color PackColor(const vec4& Color, bool Premultiply = false)
+{
+    vec4 Clamped = glm::clamp(Color, 0.0f, 1.0f);
+    if (Premultiply)
+    {
+        Clamped.r *= Clamped.a;
+        Clamped.g *= Clamped.a;
+        Clamped.b *= Clamped.a;
+    }
+
+    color Result;
+    Result.R = (u8)(Clamped.r * 255.0f + 0.5f);
+    Result.G = (u8)(Clamped.g * 255.0f + 0.5f);
+    Result.B = (u8)(Clamped.b * 255.0f + 0.5f);
+    Result.A = (u8)(Clamped.a * 255.0f + 0.5f);
     return Result;
 }
 
+// Converts four colors per iteration: clamp, scale, round and narrow the
+// sixteen channels to bytes with two saturating packs.
+global void PackColors(const vec4* Colors, color* Packed, u32 Count, bool Premultiply = false)
+{
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 Scale = _mm_set1_ps(255.0f);
+    __m128 KeepAlpha = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+    u32 i = 0;
+    for (; i + 4 <= Count; i += 4)
+    {
+        __m128i Channels[4];
+
+        for (s32 Lane = 0; Lane < 4; Lane++)
+        {
+            __m128 Color = _mm_loadu_ps(&Colors[i + Lane][0]);
+            Color = _mm_min_ps(_mm_max_ps(Color, Zero), One);
+
+            if (Premultiply)
+            {
+                __m128 Alpha = _mm_shuffle_ps(Color, Color, _MM_SHUFFLE(3, 3, 3, 3));
+                __m128 Multiplied = _mm_mul_ps(Color, Alpha);
+                Color = _mm_or_ps(_mm_and_ps(KeepAlpha, Color), _mm_andnot_ps(KeepAlpha, Multiplied));
+            }
+
+            Channels[Lane] = _mm_cvtps_epi32(_mm_mul_ps(Color, Scale));
+        }
+
+        __m128i Low = _mm_packs_epi32(Channels[0], Channels[1]);
+        __m128i High = _mm_packs_epi32(Channels[2], Channels[3]);
+        _mm_storeu_si128((__m128i*)(Packed + i), _mm_packus_epi16(Low, High));
+    }
+
+    for (; i < Count; i++)
+    {
+        Packed[i] = PackColor(Colors[i], Premultiply);
+    }
+}
+
+// Per-thread buffer for the float color overloads, reused across calls.
+internal color* GetColorScratch(u32 Count)
+{
+    if (Count > ColorScratchCapacity)
+    {
+        ColorScratch = (color*)realloc(ColorScratch, sizeof(color) * Count);
+        ColorScratchCapacity = Count;
+    }
+    return ColorScratch;
+}
+
 /*
 ================================
 Vertex Buffer
 ================================
 */
 
+template <typename format>
 internal vertex_buffer CreateVertexBuffer(u64 Capacity, GLenum Usage)
 {
     vertex_buffer Buffer = {};
     Buffer.Capacity = Capacity;
+    Buffer.IndexCapacity = Capacity / 4 * 6;
     Buffer.Usage = Usage;
-    Buffer.Positions = (f32*)malloc(sizeof(f32) * 3 * Capacity);
-    Buffer.TexCoords = (f32*)malloc(sizeof(f32) * 2 * Capacity);
-    Buffer.Colors = (f32*)malloc(sizeof(f32) * 4 * Capacity);
-    Buffer.Indices = (u32*)malloc(sizeof(u32) * Capacity);
+    Buffer.Stride = format::Stride;
+    Buffer.Vertices = (u8*)malloc(format::Stride * Capacity);
+    Buffer.Indices = (u32*)malloc(sizeof(u32) * Buffer.IndexCapacity);
 
-    glGenBuffers(4, Buffer.Vbos);
+    glGenBuffers(1, &Buffer.VertexVbo);
+    glGenBuffers(1, &Buffer.IndexVbo);
     glGenVertexArrays(1, &Buffer.Vao);
     glBindVertexArray(Buffer.Vao);
 
-    // Positions
-    glBindBuffer(GL_ARRAY_BUFFER, Buffer.Vbos[ATTRIB_POSITION]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 3 * Capacity, 0, Usage);
-    glEnableVertexAttribArray(ATTRIB_POSITION);
-    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    // TexCoords
-    glBindBuffer(GL_ARRAY_BUFFER, Buffer.Vbos[ATTRIB_TEXCOORD]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 2 * Capacity, 0, Usage);
-    glEnableVertexAttribArray(ATTRIB_TEXCOORD);
-    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    
-    // Colors
-    glBindBuffer(GL_ARRAY_BUFFER, Buffer.Vbos[ATTRIB_COLOR]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 4 * Capacity, 0, Usage);
-    glEnableVertexAttribArray(ATTRIB_COLOR);
-    glVertexAttribPointer(ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    
-    // Indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Buffer.Vbos[3]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u32) * 6 * Capacity, 0, Usage);
+    glBindBuffer(GL_ARRAY_BUFFER, Buffer.VertexVbo);
+    glBufferData(GL_ARRAY_BUFFER, format::Stride * Capacity, 0, Usage);
+    format::Setup();
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Buffer.IndexVbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u32) * Buffer.IndexCapacity, 0, Usage);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -64,6 +146,21 @@ internal vertex_buffer CreateVertexBuffer(u64 Capacity, GLenum Usage)
     return Buffer;
 }
 
+// Context storage only needs the stride, since it never reaches GL directly.
+internal u32 BatchVertexStride(s32 Mode)
+{
+    u32 Strides[R_MODE_COUNT] = {
+        batch_format<R_POINTS>::type::Stride,
+        batch_format<R_LINES>::type::Stride,
+        batch_format<R_LINE_STRIPS>::type::Stride,
+        batch_format<R_TRIANGLES>::type::Stride,
+        batch_format<R_TEXTURES>::type::Stride,
+        batch_format<R_THICK_LINES>::type::Stride,
+        batch_format<R_SHAPES>::type::Stride
+    };
+    return Strides[Mode];
+}
+
 /*
 ================================
 Texture
@@ -122,354 +219,2961 @@ internal u32 CreateShader(const char* Code, GLenum Type)
     return Shader;
 }
 
-global u32 CreateProgram(u32 VertexShader, u32 FragmentShader)
+internal bool CheckProgramLinked(u32 Program, bool Log)
 {
-    u32 Program = glCreateProgram();
-    glAttachShader(Program, VertexShader);
-    glAttachShader(Program, FragmentShader);
-    glLinkProgram(Program);
-
     GLint Linked = GL_FALSE;
     glGetProgramiv(Program, GL_LINK_STATUS, &Linked);
 
-    if (!Linked)
+    if (!Linked && Log)
     {
         char Message[4096];
         s32 Ignore;
         glGetProgramInfoLog(Program, 4096, &Ignore, Message);
         printf("%s\n", Message);
-        return 0;
     }
-    glDeleteShader(VertexShader);
-    glDeleteShader(FragmentShader);
-
-    return Program;
+    return Linked == GL_TRUE;
 }
 
-global u32 CreateShaderProgram()
+global u32 CreateProgram(u32 VertexShader, u32 FragmentShader)
 {
-    const char* VertexShaderCode = GLSL(
-        in vec3 VertPosition;
-        in vec2 VertTexCoord;
-        in vec4 VertColor;
-
-        out vec4 Color;
-        out vec2 TexCoord;
-
-        uniform mat4 Projection;
-        uniform mat4 ModelView;
-
-        void main()
-        {
-            gl_Position = Projection * ModelView * vec4(VertPosition, 1.0);
-            Color = VertColor;
-            TexCoord = VertTexCoord;
-        }
-    );
-
-    const char* FragmentShaderCode = GLSL(
-        in vec4 Color;
-        in vec2 TexCoord;
-        out vec4 FragColor;
-
-        uniform float HasTexture;
-        uniform sampler2D Texture;
-
-        void main()
-        {
-            FragColor = mix(Color, texture(Texture, TexCoord) * Color, HasTexture);
-            //FragColor = vec4(1.0, 0.0, HasTexture, 1.0);
-            //FragColor = vec4(1.0);
-        }
-    );
-
-    u32 VertexShader = CreateShader(VertexShaderCode, GL_VERTEX_SHADER);
-    u32 FragmentShader = CreateShader(FragmentShaderCode, GL_FRAGMENT_SHADER);
-    u32 Program = CreateProgram(VertexShader, FragmentShader);
+    u32 Program = glCreateProgram();
+    glAttachShader(Program, VertexShader);
+    glAttachShader(Program, FragmentShader);
 
+    // Attribute bindings only take effect on the next link
     glBindAttribLocation(Program, ATTRIB_POSITION, "VertPosition");
     glBindAttribLocation(Program, ATTRIB_TEXCOORD, "VertTexCoord");
     glBindAttribLocation(Program, ATTRIB_COLOR,    "VertColor");
+    glBindAttribLocation(Program, ATTRIB_ENDPOINTS, "VertEndpoints");
+    glBindAttribLocation(Program, ATTRIB_SHAPE,    "VertShape");
+    glBindAttribLocation(Program, ATTRIB_BOUNDS,   "VertBounds");
+
+    if (RenderState.ProgramCache.Enabled)
+    {
+        RenderState.ProgramCache.ProgramParameteri(Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    glLinkProgram(Program);
+
+    if (!CheckProgramLinked(Program, true))
+    {
+        return 0;
+    }
+    glDeleteShader(VertexShader);
+    glDeleteShader(FragmentShader);
 
     return Program;
 }
 
 /*
 ================================
-Render Batch
+Program Cache
 ================================
 */
 
-internal void PushVertex(render_batch* Batch, const vec3& Position, const vec2& TexCoord, const vec4& Color)
+internal void InitProgramCache(program_cache* Cache, GLADloadfunc Load)
 {
-    memcpy(Batch->Buffer.Positions + Batch->Buffer.VertexCount * 3, &Position[0], sizeof(vec3));
-    memcpy(Batch->Buffer.TexCoords + Batch->Buffer.VertexCount * 2, &TexCoord[0], sizeof(vec2));
-    memcpy(Batch->Buffer.Colors + Batch->Buffer.VertexCount * 4, &Color[0], sizeof(vec4));
-    Batch->Buffer.VertexCount++;
-}
+    *Cache = {};
+    if (!Load) return;
 
-internal void PushVertex(render_batch* Batch, f32* Position, f32* TexCoord, f32* Color)
-{
-    memcpy(Batch->Buffer.Positions + Batch->Buffer.VertexCount * 3, Position, sizeof(f32) * 3);
-    memcpy(Batch->Buffer.TexCoords + Batch->Buffer.VertexCount * 2, TexCoord, sizeof(f32) * 2);
-    memcpy(Batch->Buffer.Colors + Batch->Buffer.VertexCount * 4, Color, sizeof(f32) * 4);
-    Batch->Buffer.VertexCount++;
-}
+    Cache->GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)Load("glGetProgramBinary");
+    Cache->ProgramBinary = (PFNGLPROGRAMBINARYPROC)Load("glProgramBinary");
+    Cache->ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)Load("glProgramParameteri");
 
-internal void PushVertex(render_batch* Batch, f32* Position, f32* Color)
-{
-    memcpy(Batch->Buffer.Positions + Batch->Buffer.VertexCount * 3, Position, sizeof(f32) * 3);
-    memcpy(Batch->Buffer.Colors    + Batch->Buffer.VertexCount * 4, Color, sizeof(f32) * 4);
-    Batch->Buffer.VertexCount++;
+    GLint FormatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &FormatCount);
+    glGetError();
+
+    Cache->Enabled = Cache->GetProgramBinary && Cache->ProgramBinary &&
+        Cache->ProgramParameteri && FormatCount > 0;
+
+    Cache->DriverHash = HashString((const char*)glGetString(GL_VENDOR));
+    Cache->DriverHash = HashString((const char*)glGetString(GL_RENDERER), Cache->DriverHash);
+    Cache->DriverHash = HashString((const char*)glGetString(GL_VERSION), Cache->DriverHash);
 }
 
-internal void PushIndex(render_batch* Batch, u32* Indices, u64 Count)
+internal void GetProgramCachePath(u64 Hash, char* Path, u64 PathSize)
 {
-    memcpy(Batch->Buffer.Indices + Batch->Buffer.ElementCount, Indices, sizeof(u32) * Count);
-    Batch->Buffer.ElementCount += Count;
+    snprintf(Path, PathSize, "shader_%016llx.bin", (unsigned long long)Hash);
 }
 
-internal void FlushRenderBatch(render_batch* Batch)
+internal u32 LoadCachedProgram(program_cache* Cache, u64 Hash)
 {
-    if (!Batch->Buffer.VertexCount) return;
+    char Path[64];
+    GetProgramCachePath(Hash, Path, sizeof(Path));
 
-    struct buffer_layout
-    {
-        u64 Size;
-        f32* Data;
-    };
+    FILE* File = fopen(Path, "rb");
+    if (!File) return 0;
 
-    buffer_layout Layout[] = {
-        { 3, Batch->Buffer.Positions },
-        { 2, Batch->Buffer.TexCoords },
-        { 4, Batch->Buffer.Colors },
-    };
+    fseek(File, 0, SEEK_END);
+    long FileSize = ftell(File);
+    fseek(File, 0, SEEK_SET);
 
-    // Update vertex buffers
-    for (s32 i = 0; i < ATTRIB_COUNT; i++)
+    u32 Program = 0;
+    program_binary_header Header = {};
+
+    // A truncated or corrupt file must not drive the allocation size
+    if (fread(&Header, sizeof(Header), 1, File) == 1 &&
+        Header.Magic == PROGRAM_CACHE_MAGIC && Header.Hash == Hash &&
+        Header.Length > 0 && FileSize >= 0 &&
+        (u64)FileSize - sizeof(Header) == Header.Length)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, Batch->Buffer.Vbos[i]);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(f32) * Layout[i].Size * Batch->Buffer.VertexCount, (const void*)Layout[i].Data);
+        void* Binary = malloc(Header.Length);
+        if (Binary && fread(Binary, 1, Header.Length, File) == Header.Length)
+        {
+            Program = glCreateProgram();
+            Cache->ProgramBinary(Program, Header.Format, Binary, Header.Length);
+
+            // The driver may reject a binary from a different build
+            if (!CheckProgramLinked(Program, false))
+            {
+                glDeleteProgram(Program);
+                Program = 0;
+            }
+        }
+        free(Binary);
     }
 
-    // Update index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Batch->Buffer.Vbos[3]);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(u32) * Batch->Buffer.ElementCount, (const void*)Batch->Buffer.Indices);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    fclose(File);
+    return Program;
+}
 
-    // Perform rendition
-    glUseProgram(RenderState.Program);
+internal void StoreCachedProgram(program_cache* Cache, u64 Hash, u32 Program)
+{
+    GLint Length = 0;
+    glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &Length);
+    if (Length <= 0) return;
 
-    GLint ProjectionID = glGetUniformLocation(RenderState.Program, "Projection");
-    GLint ModelViewID = glGetUniformLocation(RenderState.Program, "ModelView");
-    GLint HasSamplerID = glGetUniformLocation(RenderState.Program, "HasTexture");
+    program_binary_header Header = {};
+    Header.Magic = PROGRAM_CACHE_MAGIC;
+    Header.Hash = Hash;
 
-    glUniformMatrix4fv(ProjectionID, 1, 0, &RenderState.Projection[0][0]);
-    glUniformMatrix4fv(ModelViewID, 1, 0, &RenderState.ModelView[0][0]);
-    glUniform1f(HasSamplerID, (f32)(Batch->Texture != 0));
+    void* Binary = malloc(Length);
+    if (!Binary) return;
 
-    glBindTexture(GL_TEXTURE_2D, Batch->Texture);
+    GLsizei Written = 0;
+    GLenum Format = 0;
+    Cache->GetProgramBinary(Program, Length, &Written, &Format, Binary);
+    Header.Format = Format;
+    Header.Length = (u32)Written;
 
-    glBindVertexArray(Batch->Buffer.Vao);
+    char Path[64];
+    GetProgramCachePath(Hash, Path, sizeof(Path));
 
-    if (Batch->Mode == GL_TRIANGLES)
-    {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Batch->Buffer.Vbos[3]);
-        glDrawElements(Batch->Mode, Batch->Buffer.ElementCount, GL_UNSIGNED_INT, 0);
-    }
-    else
+    FILE* File = fopen(Path, "wb");
+    if (File)
     {
-        glDrawArrays(Batch->Mode, 0, Batch->Buffer.VertexCount);
+        fwrite(&Header, sizeof(Header), 1, File);
+        fwrite(Binary, 1, Written, File);
+        fclose(File);
     }
-
-    Batch->Buffer.VertexCount = 0;
-    Batch->Buffer.ElementCount = 0;
+    free(Binary);
 }
 
-/*
-================================
-Renderer
-================================
-*/
-
-global void InitRenderer(s32 Width, s32 Height)
+// Loads the program from the binary cache when a matching blob exists and
+// compiles, links and stores it otherwise.
+global u32 CreateCachedProgram(const char* VertexShaderCode, const char* FragmentShaderCode)
 {
-    RenderState.Program = CreateShaderProgram();
-    RenderState.FramebufferWidth = Width;
-    RenderState.FramebufferHeight = Height;
+    program_cache* Cache = &RenderState.ProgramCache;
+    f64 Start = GetWallClock();
 
-    GLenum DrawModes[] = { GL_POINTS, GL_LINES, GL_TRIANGLES, GL_TRIANGLES };
+    u64 Hash = HashString(VertexShaderCode, Cache->DriverHash);
+    Hash = HashString(FragmentShaderCode, Hash);
 
-    for (s32 BatchIndex = 0; BatchIndex < R_MODE_COUNT; BatchIndex++)
+    u32 Program = Cache->Enabled ? LoadCachedProgram(Cache, Hash) : 0;
+
+    if (Program)
     {
-        RenderState.RenderBatches[BatchIndex].Buffer = CreateVertexBuffer(RENDER_BATCH_MAX_CAPACITY, GL_STREAM_DRAW);
-        RenderState.RenderBatches[BatchIndex].Mode = DrawModes[BatchIndex];
+        Cache->Hits++;
     }
-}
-
-global void BeginFrame()
-{
-    RenderState.Projection = glm::ortho(0.0f,
-        (f32)RenderState.FramebufferWidth,
-        (f32)RenderState.FramebufferHeight,
-        0.0f, -1.0f, 1.0f);
-    RenderState.ModelView = glm::mat4(1.0f);
-}
-
-global void EndFrame()
-{
-    for (s32 BatchIndex = 0; BatchIndex < R_MODE_COUNT; ++BatchIndex)
+    else
     {
-        FlushRenderBatch(RenderState.RenderBatches + BatchIndex);
+        u32 VertexShader = CreateShader(VertexShaderCode, GL_VERTEX_SHADER);
+        u32 FragmentShader = CreateShader(FragmentShaderCode, GL_FRAGMENT_SHADER);
+        Program = CreateProgram(VertexShader, FragmentShader);
+        Cache->Misses++;
+
+        if (Program && Cache->Enabled)
+        {
+            StoreCachedProgram(Cache, Hash, Program);
+        }
     }
-}
 
-global void ClearScreen(color Color)
-{
-    glClear(GL_COLOR_BUFFER_BIT);
+    Cache->Seconds += GetWallClock() - Start;
+    return Program;
 }
 
-global void DrawPoint(s32 X, s32 Y, color Color)
+// Inserts the variant's feature constants right after the #version line.
+internal void ComposeVariantSource(const char* Code, u32 Features, char* Source, u64 SourceSize)
 {
-    render_batch *RenderBatch = &RenderState.RenderBatches[R_POINTS];
-    if (RenderBatch->Buffer.VertexCount + 1 >= RenderBatch->Buffer.Capacity)
-    {
-        FlushRenderBatch(RenderBatch);
-    }
-    vec3 Position = glm::vec3(X, Y, RenderState.CurrentDepth);
-    vec2 TexCoord = glm::vec2(0.0f, 0.0f);
-    PushVertex(RenderBatch, Position, TexCoord, ColorRangeZeroOne(Color));
+    const char* Body = strchr(Code, '\n') + 1;
+
+    snprintf(Source, SourceSize,
+        "%.*s"
+        "const bool Textured = %s;\n"
+        "const bool AlphaTest = %s;\n"
+        "const bool Premultiplied = %s;\n"
+        "const bool Sdf = %s;\n"
+        "%s",
+        (s32)(Body - Code), Code,
+        (Features & SHADER_TEXTURED) ? "true" : "false",
+        (Features & SHADER_ALPHA_TEST) ? "true" : "false",
+        (Features & SHADER_PREMULTIPLIED) ? "true" : "false",
+        (Features & SHADER_SDF) ? "true" : "false",
+        Body);
 }
 
-global void DrawLine(s32 X1, s32 Y1, s32 X2, s32 Y2, color Color)
+internal void InitShaderVariant(shader_variant* Variant, const char* VertexShaderCode, const char* FragmentSource)
 {
-    render_batch *RenderBatch = &RenderState.RenderBatches[R_LINES];
-    if (RenderBatch->Buffer.VertexCount + 2 >= RenderBatch->Buffer.Capacity)
-    {
-        FlushRenderBatch(RenderBatch);
-    }
-    vec3 V1 = vec3(X1, Y1, RenderState.CurrentDepth);
-    vec3 V2 = vec3(X2, Y2, RenderState.CurrentDepth);
-    vec2 TexCoord = vec2(0.0f, 0.0f);
-    PushVertex(RenderBatch, V1, TexCoord, ColorRangeZeroOne(Color));
-    PushVertex(RenderBatch, V2, TexCoord, ColorRangeZeroOne(Color));
+    Variant->Program = CreateCachedProgram(VertexShaderCode, FragmentSource);
+    Variant->ProjectionLocation = glGetUniformLocation(Variant->Program, "Projection");
+    Variant->ModelViewLocation = glGetUniformLocation(Variant->Program, "ModelView");
+    Variant->OriginLocation = glGetUniformLocation(Variant->Program, "Origin");
+    Variant->MatrixVersion = 0;
 }
 
-global void DrawRectLines(s32 X, s32 Y, s32 Width, s32 Height, color Color)
+// Variant table for primitives that compute their own coverage and never
+// sample a texture, so the textured variants stay empty.
+internal void CreateUntexturedVariants(shader_variant* Variants, const char* VertexShaderCode, const char* FragmentShaderCode)
 {
-    render_batch* RenderBatch = &RenderState.RenderBatches[R_LINES];
-    if (RenderBatch->Buffer.VertexCount + 8 >= RenderBatch->Buffer.Capacity)
-    {
-        FlushRenderBatch(RenderBatch);
-    }
-
-    ivec2 Factors[] = {
-        { 0, 0 }, { 1, 0 },
-        { 1, 0 }, { 1, 1 },
-        { 1, 1 }, { 0, 1 },
-        { 0, 1 }, { 0, 0 }
-    };
+    char FragmentSource[4096];
 
-    for (s32 FactorIndex = 0; FactorIndex < 8; FactorIndex += 2)
+    for (u32 Features = 0; Features < SHADER_VARIANT_COUNT; Features++)
     {
-        s32 X1 = X + Width  * Factors[FactorIndex + 0][0];
-        s32 Y1 = Y + Height * Factors[FactorIndex + 0][1];
-        s32 X2 = X + Width  * Factors[FactorIndex + 1][0];
-        s32 Y2 = Y + Height * Factors[FactorIndex + 1][1];
+        if (Features & SHADER_TEXTURED) continue;
 
-        DrawLine(X1, Y1, X2, Y2, Color);
+        ComposeVariantSource(FragmentShaderCode, Features, FragmentSource, sizeof(FragmentSource));
+        InitShaderVariant(Variants + Features, VertexShaderCode, FragmentSource);
     }
 }
 
-global void DrawRect(s32 X, s32 Y, s32 Width, s32 Height, color Color)
+global void CreateShaderVariants()
 {
-    render_batch* RenderBatch = &RenderState.RenderBatches[R_TRIANGLES];
-
-    if (RenderBatch->Buffer.VertexCount + 4 >= RenderBatch->Buffer.Capacity)
-    {
-        FlushRenderBatch(RenderBatch);
-    }
+    const char* VertexShaderCode = GLSL(
+        in vec2 VertPosition;
+        in vec2 VertTexCoord;
+        in vec4 VertColor;
 
-    vec3 Vertices[] = {
-        vec3(X        , Y         , RenderState.CurrentDepth),
-        vec3(X        , Y + Height, RenderState.CurrentDepth),
-        vec3(X + Width, Y + Height, RenderState.CurrentDepth),
-        vec3(X + Width, Y         , RenderState.CurrentDepth)
-    };
+        out vec4 Color;
+        out vec2 TexCoord;
 
-    vec2 TexCoord[] = {
-        { 0.0f, 0.0f },
-        { 0.0f, 1.0f },
-        { 1.0f, 1.0f },
-        { 1.0f, 0.0f }
-    };
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform vec3 Origin;
 
-    vec4 VertColor = ColorRangeZeroOne(Color);
+        void main()
+        {
+            gl_Position = Projection * ModelView * vec4(vec3(VertPosition, 0.0) + Origin, 1.0);
+            Color = VertColor;
+            TexCoord = VertTexCoord;
+        }
+    );
 
-    u32 Indices[] = {
-        RenderBatch->Buffer.VertexCount + 0,
-        RenderBatch->Buffer.VertexCount + 1,
-        RenderBatch->Buffer.VertexCount + 2,
-        RenderBatch->Buffer.VertexCount + 0,
-        RenderBatch->Buffer.VertexCount + 2,
-        RenderBatch->Buffer.VertexCount + 3
-    };
+    // The feature constants are compile-time, so the driver strips every
+    // branch a variant does not use, including the texture fetch.
+    const char* FragmentShaderCode = GLSL(
+        in vec4 Color;
+        in vec2 TexCoord;
+        out vec4 FragColor;
 
-    for (s32 i = 0; i < 4; i++)
-    {
-        PushVertex(RenderBatch, Vertices[i], TexCoord[i], VertColor);
-    }
+        uniform sampler2D Texture;
 
-    PushIndex(RenderBatch, Indices, 6);
-}
+        void main()
+        {
+            vec4 Result = Color;
+
+            if (Textured)
+            {
+                vec4 Sample = texture(Texture, TexCoord);
+                if (Sdf)
+                {
+                    float Distance = Sample.a;
+                    float Width = fwidth(Distance);
+                    Sample = vec4(1.0, 1.0, 1.0, smoothstep(0.5 - Width, 0.5 + Width, Distance));
+                }
+                Result *= Sample;
+            }
+
+            if (AlphaTest && Result.a < 0.5)
+            {
+                discard;
+            }
+
+            if (Premultiplied)
+            {
+                Result.rgb *= Result.a;
+            }
+
+            FragColor = Result;
+        }
+    );
 
-global void DrawTexture(texture* Texture, const rect& SrcRect, const rect& DstRect, color Color)
-{
-    render_batch* RenderBatch = &RenderState.RenderBatches[R_TEXTURES];
+    char FragmentSource[4096];
 
-    if (RenderBatch->Buffer.VertexCount + 4 >= RenderBatch->Buffer.Capacity)
+    for (u32 Features = 0; Features < SHADER_VARIANT_COUNT; Features++)
     {
-        FlushRenderBatch(RenderBatch);
+        ComposeVariantSource(FragmentShaderCode, Features, FragmentSource, sizeof(FragmentSource));
+
+        InitShaderVariant(RenderState.Variants + Features, VertexShaderCode, FragmentSource);
     }
 
-    vec3 Vertices[] = {
-        vec3(DstRect.X                , DstRect.Y                 , RenderState.CurrentDepth),
-        vec3(DstRect.X                , DstRect.Y + DstRect.Height, RenderState.CurrentDepth),
-        vec3(DstRect.X + DstRect.Width, DstRect.Y + DstRect.Height, RenderState.CurrentDepth),
-        vec3(DstRect.X + DstRect.Width, DstRect.Y                 , RenderState.CurrentDepth)
-    };
+    // Thick lines: every instance is one segment, expanded by gl_VertexID
+    // into a quad one pixel wider than the line on every side. Local is the
+    // fragment's position along and across the segment, in pixels.
+    const char* LineVertexShaderCode = GLSL(
+        in vec4 VertEndpoints;
+        in vec4 VertShape;
+        in vec4 VertColor;
 
-    f32 U = (f32)SrcRect.X / Texture->Width;
-    f32 V = (f32)SrcRect.Y / Texture->Height;
-    f32 W = (f32)SrcRect.Width / Texture->Width;
-    f32 H = (f32)SrcRect.Height / Texture->Height;
+        out vec4 Color;
+        out vec2 Local;
+        flat out vec3 Segment;
+        flat out vec2 Caps;
 
-    vec2 TexCoord[4] = {
-        { U    , V     },        
-        { U    , V + H },        
-        { U + W, V + H },        
-        { U + W, V     }
-    };
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform vec3 Origin;
 
-    vec4 VertColor = ColorRangeZeroOne(Color);
+        void main()
+        {
+            vec2 Start = VertEndpoints.xy;
+            vec2 End = VertEndpoints.zw;
+            float Length = length(End - Start);
+            vec2 Dir = Length > 0.0 ? (End - Start) / Length : vec2(1.0, 0.0);
+            vec2 Normal = vec2(-Dir.y, Dir.x);
+
+            int Flags = int(VertShape.w);
+            bool Round = (Flags & 1) != 0;
+            bool StartJoined = (Flags & 2) != 0;
+            bool EndJoined = (Flags & 4) != 0;
+
+            float Extent = VertShape.x + 1.0;
+            float Cap = Round ? Extent : 1.0;
+            float Side = float(gl_VertexID & 1) * 2.0 - 1.0;
+
+            // Joined ends are sheared onto the miter line shared with the
+            // neighboring segment, so the two meet without gap or overlap
+            float Along;
+            if (gl_VertexID >= 2) Along = Length + (EndJoined ? Side * VertShape.z * Extent : Cap);
+            else Along = StartJoined ? Side * VertShape.y * Extent : -Cap;
+
+            vec2 Position = Start + Dir * Along + Normal * Side * Extent;
+            gl_Position = Projection * ModelView * vec4(vec3(Position, 0.0) + Origin, 1.0);
 
-    u32 Indices[] = {
-        RenderBatch->Buffer.VertexCount + 0,
-        RenderBatch->Buffer.VertexCount + 1,
-        RenderBatch->Buffer.VertexCount + 2,
-        RenderBatch->Buffer.VertexCount + 0,
-        RenderBatch->Buffer.VertexCount + 2,
-        RenderBatch->Buffer.VertexCount + 3
-    };
+            Color = VertColor;
+            Local = vec2(Along, Side * Extent);
+            Segment = vec3(Length, VertShape.x, Round ? 1.0 : 0.0);
+            Caps = vec2(StartJoined ? 0.0 : 1.0, EndJoined ? 0.0 : 1.0);
+        }
+    );
 
-    for (s32 i = 0; i < 4; i++)
-    {
-        PushVertex(RenderBatch, Vertices[i], TexCoord[i], VertColor);
-    }
+    // Coverage from the distance to the line's edge: a capsule for round
+    // lines, a rectangle with open joined ends otherwise.
+    const char* LineFragmentShaderCode = GLSL(
+        in vec4 Color;
+        in vec2 Local;
+        flat in vec3 Segment;
+        flat in vec2 Caps;
+        out vec4 FragColor;
 
-    PushIndex(RenderBatch, Indices, 6);
+        void main()
+        {
+            float Length = Segment.x;
+            float HalfWidth = Segment.y;
+            float Distance;
+
+            if (Segment.z > 0.0)
+            {
+                float Closest = clamp(Local.x, 0.0, Length);
+                Distance = length(vec2(Local.x - Closest, Local.y)) - HalfWidth;
+            }
+            else
+            {
+                Distance = abs(Local.y) - HalfWidth;
+                if (Caps.x > 0.0) Distance = max(Distance, -Local.x);
+                if (Caps.y > 0.0) Distance = max(Distance, Local.x - Length);
+            }
+
+            vec4 Result = Color;
+            Result.a *= clamp(0.5 - Distance, 0.0, 1.0);
+
+            if (AlphaTest && Result.a < 0.5)
+            {
+                discard;
+            }
+
+            if (Premultiplied)
+            {
+                Result.rgb *= Result.a;
+            }
+
+            FragColor = Result;
+        }
+    );
+
+    CreateUntexturedVariants(RenderState.LineVariants, LineVertexShaderCode, LineFragmentShaderCode);
+
+    // Shapes: every instance is a rounded box, expanded like the lines.
+    // Circles are boxes whose corner radius is half their size, and a
+    // positive thickness keeps only a band inside the outer edge.
+    const char* ShapeVertexShaderCode = GLSL(
+        in vec4 VertBounds;
+        in vec2 VertShape;
+        in vec4 VertColor;
+
+        out vec4 Color;
+        out vec2 Local;
+        flat out vec4 Shape;
+
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform vec3 Origin;
+
+        void main()
+        {
+            vec2 Corner = vec2(float(gl_VertexID >> 1), float(gl_VertexID & 1)) * 2.0 - 1.0;
+            Local = Corner * (VertBounds.zw + 1.0);
+
+            gl_Position = Projection * ModelView * vec4(vec3(VertBounds.xy + Local, 0.0) + Origin, 1.0);
+            Color = VertColor;
+            Shape = vec4(VertBounds.zw, VertShape);
+        }
+    );
+
+    const char* ShapeFragmentShaderCode = GLSL(
+        in vec4 Color;
+        in vec2 Local;
+        flat in vec4 Shape;
+        out vec4 FragColor;
+
+        void main()
+        {
+            vec2 HalfSize = Shape.xy;
+            float Radius = Shape.z;
+            float Thickness = Shape.w;
+
+            vec2 Q = abs(Local) - HalfSize + Radius;
+            float Distance = length(max(Q, 0.0)) + min(max(Q.x, Q.y), 0.0) - Radius;
+
+            if (Thickness > 0.0)
+            {
+                Distance = abs(Distance + Thickness * 0.5) - Thickness * 0.5;
+            }
+
+            vec4 Result = Color;
+            Result.a *= clamp(0.5 - Distance, 0.0, 1.0);
+
+            if (AlphaTest && Result.a < 0.5)
+            {
+                discard;
+            }
+
+            if (Premultiplied)
+            {
+                Result.rgb *= Result.a;
+            }
+
+            FragColor = Result;
+        }
+    );
+
+    CreateUntexturedVariants(RenderState.ShapeVariants, ShapeVertexShaderCode, ShapeFragmentShaderCode);
+
+    // DrawPointSources reads X and Y from separate arrays of any type, but
+    // shades exactly like the plain variant
+    const char* PointSourceShaderCode = GLSL(
+        in float VertX;
+        in float VertY;
+        in vec4 VertColor;
+
+        out vec4 Color;
+        out vec2 TexCoord;
+
+        uniform mat4 Projection;
+        uniform mat4 ModelView;
+        uniform float Scale;
+        uniform float Depth;
+
+        void main()
+        {
+            gl_Position = Projection * ModelView * vec4(vec2(VertX, VertY) * Scale, Depth, 1.0);
+            Color = VertColor;
+            TexCoord = vec2(0.0);
+        }
+    );
+
+    ComposeVariantSource(FragmentShaderCode, 0, FragmentSource, sizeof(FragmentSource));
+
+    point_source_state* Sources = &RenderState.PointSources;
+    Sources->Program = CreateCachedProgram(PointSourceShaderCode, FragmentSource);
+    Sources->ProjectionLocation = glGetUniformLocation(Sources->Program, "Projection");
+    Sources->ModelViewLocation = glGetUniformLocation(Sources->Program, "ModelView");
+    Sources->ScaleLocation = glGetUniformLocation(Sources->Program, "Scale");
+    Sources->DepthLocation = glGetUniformLocation(Sources->Program, "Depth");
+    Sources->Locations[POINT_SOURCE_X] = glGetAttribLocation(Sources->Program, "VertX");
+    Sources->Locations[POINT_SOURCE_Y] = glGetAttribLocation(Sources->Program, "VertY");
+    Sources->Locations[POINT_SOURCE_COLOR] = glGetAttribLocation(Sources->Program, "VertColor");
+}
+
+/*
+================================
+GL State
+================================
+*/
+
+internal void BindProgram(u32 Program)
+{
+    if (RenderState.GLState.Program == Program) return;
+
+    glUseProgram(Program);
+    RenderState.GLState.Program = Program;
+    RenderState.Stats.ProgramBinds++;
+}
+
+internal void BindTexture(u32 Texture)
+{
+    if (RenderState.GLState.Texture == Texture) return;
+
+    glBindTexture(GL_TEXTURE_2D, Texture);
+    RenderState.GLState.Texture = Texture;
+    RenderState.Stats.TextureBinds++;
+}
+
+internal void BindVertexArray(u32 Vao)
+{
+    if (RenderState.GLState.Vao == Vao) return;
+
+    glBindVertexArray(Vao);
+    RenderState.GLState.Vao = Vao;
+}
+
+// Source and destination factors for color and alpha. Alpha is kept as
+// coverage so the framebuffer stays usable as a premultiplied image.
+struct blend_func
+{
+    bool Enabled;
+    GLenum SrcColor;
+    GLenum DstColor;
+    GLenum SrcAlpha;
+    GLenum DstAlpha;
+};
+
+global blend_func BlendFuncs[BLEND_MODE_COUNT] =
+{
+    { true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA }, // BLEND_ALPHA
+    { true, GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA },       // BLEND_PREMULTIPLIED
+    { true, GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE },                                // BLEND_ADDITIVE
+    { true, GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE },                // BLEND_MULTIPLY
+    { false, GL_ONE, GL_ZERO, GL_ONE, GL_ZERO },                                    // BLEND_OPAQUE
+};
+
+// Only touches GL_BLEND when blending turns on or off, and only changes the
+// factors when they differ from the last ones set. Those survive a detour
+// through BLEND_OPAQUE, which just disables blending.
+internal void BindBlendMode(u32 Blend)
+{
+    gl_state_cache* State = &RenderState.GLState;
+    u32 Previous = State->Blend;
+    if (Previous == Blend) return;
+
+    const blend_func* Func = BlendFuncs + Blend;
+    bool WasEnabled = Previous < BLEND_MODE_COUNT && BlendFuncs[Previous].Enabled;
+
+    if (Func->Enabled && !WasEnabled) glEnable(GL_BLEND);
+    if (!Func->Enabled && (WasEnabled || Previous == BLEND_MODE_COUNT)) glDisable(GL_BLEND);
+
+    if (Func->Enabled)
+    {
+        const blend_func* Set = State->BlendFactors < BLEND_MODE_COUNT ? BlendFuncs + State->BlendFactors : 0;
+        if (!Set || Set->SrcColor != Func->SrcColor || Set->DstColor != Func->DstColor ||
+            Set->SrcAlpha != Func->SrcAlpha || Set->DstAlpha != Func->DstAlpha)
+        {
+            glBlendFuncSeparate(Func->SrcColor, Func->DstColor, Func->SrcAlpha, Func->DstAlpha);
+        }
+        State->BlendFactors = Blend;
+    }
+
+    State->Blend = Blend;
+    RenderState.Stats.BlendSwitches++;
+}
+
+// Scissor rects are in the same top-down pixels as drawing; GL counts rows
+// of the default framebuffer from the bottom.
+internal void BindScissor(const rect& Scissor)
+{
+    rect* Bound = &RenderState.GLState.Scissor;
+    if (Bound->X == Scissor.X && Bound->Y == Scissor.Y &&
+        Bound->Width == Scissor.Width && Bound->Height == Scissor.Height) return;
+
+    if (!Scissor.Width)
+    {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    else
+    {
+        if (!Bound->Width) glEnable(GL_SCISSOR_TEST);
+
+        // Render targets are drawn bottom up, so their rows need no flip
+        if (RenderState.Target)
+        {
+            glScissor(Scissor.X - RenderState.TargetX, Scissor.Y - RenderState.TargetY, Scissor.Width, Scissor.Height);
+        }
+        else
+        {
+            glScissor(Scissor.X, RenderState.FramebufferHeight - Scissor.Y - Scissor.Height, Scissor.Width, Scissor.Height);
+        }
+    }
+
+    *Bound = Scissor;
+    RenderState.Stats.ScissorChanges++;
+}
+
+// Code that changes GL state behind the cache's back calls this afterwards
+// so the cache does not skip binds it needs.
+global void InvalidateGLStateCache()
+{
+    RenderState.GLState = {};
+    RenderState.GLState.Blend = BLEND_MODE_COUNT;
+    RenderState.GLState.BlendFactors = BLEND_MODE_COUNT;
+}
+
+// Binds the variant for the feature set and uploads the matrices if they
+// changed since this program last saw them.
+internal shader_variant* BindShaderVariant(shader_variant* Variants, u32 Features)
+{
+    shader_variant* Variant = Variants + Features;
+    BindProgram(Variant->Program);
+
+    if (Variant->MatrixVersion != RenderState.MatrixVersion)
+    {
+        glUniformMatrix4fv(Variant->ProjectionLocation, 1, 0, &RenderState.Projection[0][0]);
+        glUniformMatrix4fv(Variant->ModelViewLocation, 1, 0, &RenderState.ModelView[0][0]);
+        Variant->MatrixVersion = RenderState.MatrixVersion;
+    }
+
+    return Variant;
+}
+
+internal void SetMatrices(const mat4& Projection, const mat4& ModelView)
+{
+    RenderState.Projection = Projection;
+    RenderState.ModelView = ModelView;
+    RenderState.MatrixVersion++;
+}
+
+// Folds the stats of the frame that was just drawn into the reported totals.
+internal void EndFrameStats()
+{
+    std::lock_guard<std::mutex> Guard(RenderState.StatsLock);
+    render_stats* Reported = &RenderState.ReportedStats;
+    render_stats* Stats = &RenderState.Stats;
+
+    Reported->Frames++;
+    Reported->DrawCalls += Stats->DrawCalls;
+    Reported->Vertices += Stats->Vertices;
+    Reported->ProgramBinds += Stats->ProgramBinds;
+    Reported->TextureBinds += Stats->TextureBinds;
+    Reported->BlendSwitches += Stats->BlendSwitches;
+    Reported->ScissorChanges += Stats->ScissorChanges;
+    Reported->SamplesPassed += Stats->SamplesPassed;
+    *Stats = {};
+}
+
+// Returns the totals since the previous call. Safe to call from the game
+// thread while a render thread is running.
+global render_stats TakeRenderStats()
+{
+    std::lock_guard<std::mutex> Guard(RenderState.StatsLock);
+    render_stats Result = RenderState.ReportedStats;
+    RenderState.ReportedStats = {};
+    return Result;
+}
+
+/*
+================================
+Dynamic Texture
+================================
+*/
+
+// Call on the thread that owns the GL context, before a render thread is
+// started. Returns 0 when RENDER_MAX_DYNAMIC_TEXTURES are in use.
+global dynamic_texture* CreateDynamicTexture(s32 Width, s32 Height)
+{
+    if (RenderState.DynamicTextureCount == RENDER_MAX_DYNAMIC_TEXTURES) return 0;
+
+    dynamic_texture* Result = new dynamic_texture();
+    Result->Pixels = (u8*)calloc(Width * Height, 1);
+    Result->Texture.Width = Width;
+    Result->Texture.Height = Height;
+    Result->DirtyMinY = Height;
+    Result->DirtyMaxY = 0;
+
+    GLint Swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+
+    glGenTextures(1, &Result->Texture.Handle);
+    glBindTexture(GL_TEXTURE_2D, Result->Texture.Handle);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, Width, Height, 0, GL_RED, GL_UNSIGNED_BYTE, Result->Pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, Swizzle);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    InvalidateGLStateCache();
+
+    RenderState.DynamicTextures[RenderState.DynamicTextureCount++] = Result;
+    return Result;
+}
+
+// Copies a Width x Height block into the CPU copy, or clears it when
+// Pixels is 0. Pitch is the source row length in bytes.
+global void UpdateDynamicTexture(dynamic_texture* Texture, s32 X, s32 Y, s32 Width, s32 Height, const u8* Pixels, s32 Pitch)
+{
+    std::lock_guard<std::mutex> Guard(Texture->Lock);
+    s32 TextureWidth = Texture->Texture.Width;
+
+    for (s32 Row = 0; Row < Height; Row++)
+    {
+        u8* Dest = Texture->Pixels + (Y + Row) * TextureWidth + X;
+        if (Pixels) memcpy(Dest, Pixels + Row * Pitch, Width);
+        else memset(Dest, 0, Width);
+    }
+
+    Texture->DirtyMinY = glm::min(Texture->DirtyMinY, Y);
+    Texture->DirtyMaxY = glm::max(Texture->DirtyMaxY, Y + Height);
+}
+
+// Whole rows are uploaded, so the CPU copy can be passed without a pitch.
+internal void UploadDynamicTextures()
+{
+    for (u32 i = 0; i < RenderState.DynamicTextureCount; i++)
+    {
+        dynamic_texture* Texture = RenderState.DynamicTextures[i];
+        std::lock_guard<std::mutex> Guard(Texture->Lock);
+        if (Texture->DirtyMinY >= Texture->DirtyMaxY) continue;
+
+        s32 Width = Texture->Texture.Width;
+        BindTexture(Texture->Texture.Handle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, Texture->DirtyMinY, Width, Texture->DirtyMaxY - Texture->DirtyMinY,
+            GL_RED, GL_UNSIGNED_BYTE, Texture->Pixels + Texture->DirtyMinY * Width);
+
+        Texture->DirtyMinY = Texture->Texture.Height;
+        Texture->DirtyMaxY = 0;
+    }
+}
+
+/*
+================================
+Render Batch
+================================
+*/
+
+template <s32 Mode, typename input>
+internal void PushVertex(render_batch* Batch, const input& Input)
+{
+    typedef typename batch_format<Mode>::type format;
+    format::Write(Batch->Buffer.Vertices + Batch->Buffer.VertexCount * format::Stride, Input);
+    Batch->Buffer.VertexCount++;
+}
+
+internal void PushIndex(render_batch* Batch, u32* Indices, u64 Count)
+{
+    memcpy(Batch->Buffer.Indices + Batch->Buffer.ElementCount, Indices, sizeof(u32) * Count);
+    Batch->Buffer.ElementCount += Count;
+}
+
+internal void FlushRenderBatch(render_batch* Batch)
+{
+    if (!Batch->Buffer.VertexCount) return;
+
+    // Update vertex buffer
+    glBindBuffer(GL_ARRAY_BUFFER, Batch->Buffer.VertexVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, Batch->Buffer.Stride * Batch->Buffer.VertexCount, (const void*)Batch->Buffer.Vertices);
+
+    // Update index buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Batch->Buffer.IndexVbo);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(u32) * Batch->Buffer.ElementCount, (const void*)Batch->Buffer.Indices);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Perform rendition
+    BindBlendMode(Batch->Key.Blend);
+    BindScissor(Batch->Key.Scissor);
+    shader_variant* Variant = BindShaderVariant(Batch->Variants, Batch->Key.Features);
+    glUniform3f(Variant->OriginLocation, (f32)Batch->Key.OriginX, (f32)Batch->Key.OriginY, Batch->Key.Depth);
+
+    if (Batch->Key.Features & SHADER_TEXTURED)
+    {
+        UploadDynamicTextures();
+        BindTexture(Batch->Key.Texture);
+    }
+
+    BindVertexArray(Batch->Buffer.Vao);
+
+    u32 VertexCount = Batch->Buffer.VertexCount;
+
+    if (Batch->Instanced)
+    {
+        glDrawArraysInstanced(Batch->Mode, 0, 4, Batch->Buffer.VertexCount);
+        VertexCount *= 4;
+    }
+    else if (Batch->Mode == GL_TRIANGLES || Batch->Mode == GL_LINE_STRIP)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Batch->Buffer.IndexVbo);
+        glDrawElements(Batch->Mode, Batch->Buffer.ElementCount, GL_UNSIGNED_INT, 0);
+    }
+    else
+    {
+        glDrawArrays(Batch->Mode, 0, Batch->Buffer.VertexCount);
+    }
+
+    RenderState.Stats.DrawCalls++;
+    RenderState.Stats.Vertices += VertexCount;
+
+    Batch->Buffer.VertexCount = 0;
+    Batch->Buffer.ElementCount = 0;
+}
+
+internal void FlushRenderBatches()
+{
+    for (s32 BatchIndex = 0; BatchIndex < R_MODE_COUNT; ++BatchIndex)
+    {
+        FlushRenderBatch(RenderState.RenderBatches + BatchIndex);
+    }
+}
+
+/*
+================================
+Render Context
+================================
+*/
+
+internal bool BatchKeysEqual(const batch_key& A, const batch_key& B)
+{
+    return A.Texture == B.Texture && A.Features == B.Features &&
+        A.OriginX == B.OriginX && A.OriginY == B.OriginY && A.Depth == B.Depth &&
+        A.Blend == B.Blend && A.Scissor.X == B.Scissor.X && A.Scissor.Y == B.Scissor.Y &&
+        A.Scissor.Width == B.Scissor.Width && A.Scissor.Height == B.Scissor.Height;
+}
+
+// Worker contexts carry their own state. The game thread keeps using the
+// global one even while it records into a frame packet.
+internal draw_state* CurrentDrawState()
+{
+    if (ActiveContext && ActiveContext != DefaultContext) return &ActiveContext->State;
+    return &RenderState.DrawState;
+}
+
+internal batch_key MakeBatchKey(u32 Texture)
+{
+    draw_state* State = CurrentDrawState();
+
+    batch_key Key = {};
+    Key.Texture = Texture;
+    Key.Features = State->Features;
+    Key.OriginX = State->OriginX;
+    Key.OriginY = State->OriginY;
+    Key.Depth = State->Depth;
+    Key.Blend = State->Blend;
+    if (Texture) Key.Features |= SHADER_TEXTURED;
+
+    // Multiply needs straight colors premultiplied so that alpha 0 leaves
+    // the destination unchanged
+    if (Key.Blend == BLEND_MULTIPLY) Key.Features |= SHADER_PREMULTIPLIED;
+    return Key;
+}
+
+// Vertex positions are stored relative to the batch origin.
+internal vec2 BatchPosition(const batch_key& Key, f32 X, f32 Y)
+{
+    return vec2(X - Key.OriginX, Y - Key.OriginY);
+}
+
+internal void GrowContextBatch(render_batch* Batch, u64 VertexCount, u64 IndexCount)
+{
+    vertex_buffer* Buffer = &Batch->Buffer;
+
+    if (Buffer->VertexCount + VertexCount > Buffer->Capacity)
+    {
+        u64 Capacity = Buffer->Capacity ? Buffer->Capacity : RENDER_CONTEXT_INITIAL_CAPACITY;
+        while (Buffer->VertexCount + VertexCount > Capacity) Capacity *= 2;
+
+        Buffer->Vertices = (u8*)realloc(Buffer->Vertices, Buffer->Stride * Capacity);
+        Buffer->Capacity = Capacity;
+    }
+
+    if (Buffer->ElementCount + IndexCount > Buffer->IndexCapacity)
+    {
+        u64 IndexCapacity = Buffer->IndexCapacity ? Buffer->IndexCapacity : RENDER_CONTEXT_INITIAL_CAPACITY / 4 * 6;
+        while (Buffer->ElementCount + IndexCount > IndexCapacity) IndexCapacity *= 2;
+
+        Buffer->Indices = (u32*)realloc(Buffer->Indices, sizeof(u32) * IndexCapacity);
+        Buffer->IndexCapacity = IndexCapacity;
+    }
+}
+
+internal void CloseRenderCommand(render_context* Context, s32 Mode)
+{
+    s32 CommandIndex = Context->OpenCommands[Mode];
+    if (CommandIndex < 0) return;
+
+    render_command* Command = Context->Commands + CommandIndex;
+    vertex_buffer* Buffer = &Context->Batches[Mode].Buffer;
+    Command->VertexCount = Buffer->VertexCount - Command->FirstVertex;
+    Command->IndexCount = Buffer->ElementCount - Command->FirstIndex;
+    Context->OpenCommands[Mode] = -1;
+}
+
+// Commands are split so that every one of them fits into a single GL batch,
+// which lets SubmitRenderContext copy them without splitting primitives.
+internal render_batch* ReserveContextBatch(render_context* Context, s32 Mode, batch_key Key, u32 VertexCount, u32 IndexCount)
+{
+    render_batch* Batch = &Context->Batches[Mode];
+
+    // Like the GL batches, a blend or depth change ends every open command,
+    // so nothing drawn later can merge into a command recorded before it
+    if (Key.Blend != Context->OpenBlend || Key.Depth != Context->OpenDepth)
+    {
+        for (s32 OpenMode = 0; OpenMode < R_MODE_COUNT; OpenMode++)
+        {
+            CloseRenderCommand(Context, OpenMode);
+        }
+        Context->OpenBlend = Key.Blend;
+        Context->OpenDepth = Key.Depth;
+    }
+
+    s32 CommandIndex = Context->OpenCommands[Mode];
+
+    if (CommandIndex >= 0)
+    {
+        render_command* Command = Context->Commands + CommandIndex;
+        u32 CommandVertices = Batch->Buffer.VertexCount - Command->FirstVertex;
+        u32 CommandIndices = Batch->Buffer.ElementCount - Command->FirstIndex;
+
+        if (!BatchKeysEqual(Command->Key, Key) ||
+            CommandVertices + VertexCount > RENDER_BATCH_MAX_CAPACITY ||
+            CommandIndices + IndexCount > RENDER_BATCH_MAX_INDICES)
+        {
+            CloseRenderCommand(Context, Mode);
+            CommandIndex = -1;
+        }
+    }
+
+    if (CommandIndex < 0)
+    {
+        if (Context->CommandCount == Context->CommandCapacity)
+        {
+            Context->CommandCapacity = Context->CommandCapacity ? Context->CommandCapacity * 2 : 64;
+            Context->Commands = (render_command*)realloc(Context->Commands, sizeof(render_command) * Context->CommandCapacity);
+        }
+
+        render_command* Command = Context->Commands + Context->CommandCount;
+        *Command = {};
+        Command->Mode = Mode;
+        Command->Key = Key;
+        Command->FirstVertex = Batch->Buffer.VertexCount;
+        Command->FirstIndex = Batch->Buffer.ElementCount;
+        Context->OpenCommands[Mode] = (s32)Context->CommandCount++;
+    }
+
+    GrowContextBatch(Batch, VertexCount, IndexCount);
+    Batch->Key = Key;
+    return Batch;
+}
+
+// The GL batch for a primitive, flushed first if it is full or has a
+// different key.
+internal render_batch* ReserveGLBatch(s32 Mode, batch_key Key, u32 VertexCount, u32 IndexCount)
+{
+    // Batches of different modes are drawn in mode order, which is only
+    // invisible while they share a blend mode and a layer. Everything drawn
+    // before a change is flushed before the first primitive after it.
+    if (Key.Blend != RenderState.PendingBlend || Key.Depth != RenderState.PendingDepth)
+    {
+        FlushRenderBatches();
+        RenderState.PendingBlend = Key.Blend;
+        RenderState.PendingDepth = Key.Depth;
+    }
+
+    render_batch* Batch = &RenderState.RenderBatches[Mode];
+
+    if ((!BatchKeysEqual(Batch->Key, Key) && Batch->Buffer.VertexCount) ||
+        Batch->Buffer.VertexCount + VertexCount > Batch->Buffer.Capacity ||
+        Batch->Buffer.ElementCount + IndexCount > Batch->Buffer.IndexCapacity)
+    {
+        FlushRenderBatch(Batch);
+    }
+
+    Batch->Key = Key;
+    return Batch;
+}
+
+// Returns the batch the next primitive has to be pushed into. On a thread
+// with a bound render_context this is the context's storage, with depth
+// passes on it is the storage of the primitive's pass, otherwise the GL
+// batch.
+internal render_batch* ReserveBatch(s32 Mode, batch_key Key, u32 VertexCount, u32 IndexCount)
+{
+    if (ActiveContext)
+    {
+        return ReserveContextBatch(ActiveContext, Mode, Key, VertexCount, IndexCount);
+    }
+
+    if (RenderState.DepthPasses)
+    {
+        render_context* Pass = RenderState.Passes + (Key.Blend == BLEND_OPAQUE ? PASS_OPAQUE : PASS_TRANSLUCENT);
+        return ReserveContextBatch(Pass, Mode, Key, VertexCount, IndexCount);
+    }
+
+    return ReserveGLBatch(Mode, Key, VertexCount, IndexCount);
+}
+
+internal void ResetRenderContext(render_context* Context)
+{
+    for (s32 Mode = 0; Mode < R_MODE_COUNT; Mode++)
+    {
+        Context->Batches[Mode].Buffer.Stride = BatchVertexStride(Mode);
+        Context->Batches[Mode].Buffer.VertexCount = 0;
+        Context->Batches[Mode].Buffer.ElementCount = 0;
+        Context->OpenCommands[Mode] = -1;
+    }
+    Context->CommandCount = 0;
+    Context->OpenBlend = BLEND_ALPHA;
+    Context->OpenDepth = 0.0f;
+}
+
+// Appends a recorded command to a batch reserved for it.
+internal void CopyRenderCommand(render_context* Context, render_command* Command, render_batch* Batch)
+{
+    vertex_buffer* Src = &Context->Batches[Command->Mode].Buffer;
+    vertex_buffer* Dst = &Batch->Buffer;
+
+    memcpy(Dst->Vertices + Dst->VertexCount * Dst->Stride, Src->Vertices + Command->FirstVertex * Src->Stride, Src->Stride * Command->VertexCount);
+
+    // Indices were recorded relative to the context's storage
+    u32 Rebase = Dst->VertexCount - Command->FirstVertex;
+    for (u32 i = 0; i < Command->IndexCount; i++)
+    {
+        u32 Index = Src->Indices[Command->FirstIndex + i];
+        Dst->Indices[Dst->ElementCount + i] = Index == RENDER_PRIMITIVE_RESTART ? Index : Index + Rebase;
+    }
+
+    Dst->VertexCount += Command->VertexCount;
+    Dst->ElementCount += Command->IndexCount;
+}
+
+// Replays a context into the GL batches. Must run on the thread that owns
+// the GL context, after every recording thread is done with this context.
+internal void SubmitRenderContext(render_context* Context)
+{
+    for (s32 Mode = 0; Mode < R_MODE_COUNT; Mode++)
+    {
+        CloseRenderCommand(Context, Mode);
+    }
+
+    for (u32 CommandIndex = 0; CommandIndex < Context->CommandCount; CommandIndex++)
+    {
+        render_command* Command = Context->Commands + CommandIndex;
+        render_batch* Batch = ReserveBatch(Command->Mode, Command->Key, Command->VertexCount, Command->IndexCount);
+        CopyRenderCommand(Context, Command, Batch);
+    }
+
+    ResetRenderContext(Context);
+}
+
+// Call on the main thread before handing the context to a worker.
+global render_context* CreateRenderContext(s32 SortKey)
+{
+    if (RenderState.ContextCount == RENDER_CONTEXT_MAX_COUNT) return 0;
+
+    render_context* Context = (render_context*)calloc(1, sizeof(render_context));
+    Context->SortKey = SortKey;
+    Context->Index = RenderState.ContextCount;
+    ResetRenderContext(Context);
+
+    RenderState.Contexts[RenderState.ContextCount++] = Context;
+    return Context;
+}
+
+// Call on the main thread once no thread records into the context. Later
+// contexts move up a slot, so their merge order stays the same.
+global void FreeRenderContext(render_context* Context)
+{
+    u32 Count = RenderState.ContextCount;
+
+    for (u32 i = 0; i < Count; i++)
+    {
+        if (RenderState.Contexts[i] != Context) continue;
+
+        for (u32 j = i; j + 1 < Count; j++)
+        {
+            RenderState.Contexts[j] = RenderState.Contexts[j + 1];
+            RenderState.Contexts[j]->Index = j;
+        }
+        RenderState.ContextCount--;
+        break;
+    }
+
+    for (s32 Mode = 0; Mode < R_MODE_COUNT; Mode++)
+    {
+        free(Context->Batches[Mode].Buffer.Vertices);
+        free(Context->Batches[Mode].Buffer.Indices);
+    }
+    free(Context->Commands);
+    free(Context);
+}
+
+// Binds the context to the calling thread. All Draw* calls made on this
+// thread until EndRenderContext are recorded into it.
+global void BeginRenderContext(render_context* Context)
+{
+    ActiveContext = Context;
+}
+
+global void EndRenderContext()
+{
+    ActiveContext = DefaultContext;
+}
+
+/*
+================================
+Clipping
+================================
+*/
+
+// Clip rects are resolved on the CPU where possible: primitives entirely
+// inside are drawn as usual, ones entirely outside are dropped, and
+// axis-aligned quads are cut down along with their texture coordinates.
+// Anything else that crosses the edge gets the clip rect as the scissor of
+// its batch key.
+
+internal const rect* CurrentClip()
+{
+    draw_state* State = CurrentDrawState();
+    if (!State->ClipDepth) return 0;
+    return State->ClipStack + glm::min(State->ClipDepth, (u32)RENDER_MAX_CLIP_DEPTH) - 1;
+}
+
+// Returns false when the bounds are outside the clip rect. They are padded
+// by a pixel to cover one-pixel lines and anti-aliased edges.
+internal bool ClipBatchKey(batch_key* Key, f32 MinX, f32 MinY, f32 MaxX, f32 MaxY)
+{
+    const rect* Clip = CurrentClip();
+    if (!Clip) return true;
+    if (Clip->Width <= 0 || Clip->Height <= 0) return false;
+
+    f32 ClipMinX = (f32)Clip->X;
+    f32 ClipMinY = (f32)Clip->Y;
+    f32 ClipMaxX = (f32)(Clip->X + Clip->Width);
+    f32 ClipMaxY = (f32)(Clip->Y + Clip->Height);
+
+    MinX -= 1.0f;
+    MinY -= 1.0f;
+    MaxX += 1.0f;
+    MaxY += 1.0f;
+
+    if (MaxX <= ClipMinX || MinX >= ClipMaxX || MaxY <= ClipMinY || MinY >= ClipMaxY) return false;
+
+    if (MinX < ClipMinX || MinY < ClipMinY || MaxX > ClipMaxX || MaxY > ClipMaxY)
+    {
+        Key->Scissor = *Clip;
+    }
+    return true;
+}
+
+// For bulk primitives whose bounds are not worth a pass over the data.
+internal bool ScissorBatchKey(batch_key* Key)
+{
+    return ClipBatchKey(Key, -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX);
+}
+
+// Clips by the bounds of Points grown by Pad on every side.
+internal bool ClipPointsKey(batch_key* Key, const vec2* Points, u32 Count, f32 Pad)
+{
+    if (!CurrentClip()) return true;
+    if (!Count) return false;
+
+    f32 MinX = Points[0].x;
+    f32 MinY = Points[0].y;
+    f32 MaxX = MinX;
+    f32 MaxY = MinY;
+
+    for (u32 i = 1; i < Count; i++)
+    {
+        MinX = fminf(MinX, Points[i].x);
+        MinY = fminf(MinY, Points[i].y);
+        MaxX = fmaxf(MaxX, Points[i].x);
+        MaxY = fmaxf(MaxY, Points[i].y);
+    }
+
+    return ClipBatchKey(Key, MinX - Pad, MinY - Pad, MaxX + Pad, MaxY + Pad);
+}
+
+// Clips the span Min..Max to ClipMin..ClipMax and moves the texture
+// coordinates with it. A reversed span is flipped first.
+internal bool ClipSpan(f32 ClipMin, f32 ClipMax, f32* Min, f32* Max, f32* UvMin, f32* UvMax)
+{
+    if (*Min > *Max)
+    {
+        f32 Swap = *Min; *Min = *Max; *Max = Swap;
+        Swap = *UvMin; *UvMin = *UvMax; *UvMax = Swap;
+    }
+
+    f32 NewMin = fmaxf(*Min, ClipMin);
+    f32 NewMax = fminf(*Max, ClipMax);
+    if (NewMin >= NewMax) return false;
+
+    f32 Size = *Max - *Min;
+    if (Size > 0.0f)
+    {
+        f32 UvStart = *UvMin;
+        f32 UvScale = (*UvMax - *UvMin) / Size;
+        *UvMin = UvStart + (NewMin - *Min) * UvScale;
+        *UvMax = UvStart + (NewMax - *Min) * UvScale;
+    }
+
+    *Min = NewMin;
+    *Max = NewMax;
+    return true;
+}
+
+// Cuts an axis-aligned quad from (X0, Y0) to (X1, Y1) down to Clip. A quad
+// that is clipped away collapses to a point, so bulk fills that write a
+// fixed slot per quad can still write it.
+internal bool ClipQuad(const rect& Clip, f32* X0, f32* Y0, f32* X1, f32* Y1, f32* U0, f32* V0, f32* U1, f32* V1)
+{
+    bool Visible =
+        ClipSpan((f32)Clip.X, (f32)(Clip.X + Clip.Width), X0, X1, U0, U1) &&
+        ClipSpan((f32)Clip.Y, (f32)(Clip.Y + Clip.Height), Y0, Y1, V0, V1);
+
+    if (!Visible)
+    {
+        *X1 = *X0;
+        *Y1 = *Y0;
+    }
+    return Visible;
+}
+
+// Nine-slice variant: clamps the four ascending grid lines in Lines to
+// Min..Max and moves each one's texture coordinate along its cell.
+internal bool ClipGridLines(f32 Min, f32 Max, f32* Lines, f32* Uvs)
+{
+    if (Lines[3] <= Min || Lines[0] >= Max) return false;
+
+    f32 NewLines[4];
+    f32 NewUvs[4];
+
+    for (s32 i = 0; i < 4; i++)
+    {
+        f32 Line = glm::clamp(Lines[i], Min, Max);
+
+        s32 Cell = 0;
+        while (Cell < 2 && Lines[Cell + 1] < Line) Cell++;
+
+        f32 Size = Lines[Cell + 1] - Lines[Cell];
+        f32 T = Size > 0.0f ? (Line - Lines[Cell]) / Size : 0.0f;
+        NewLines[i] = Line;
+        NewUvs[i] = Uvs[Cell] + (Uvs[Cell + 1] - Uvs[Cell]) * T;
+    }
+
+    memcpy(Lines, NewLines, sizeof(NewLines));
+    memcpy(Uvs, NewUvs, sizeof(NewUvs));
+    return true;
+}
+
+/*
+================================
+Depth Passes
+================================
+*/
+
+// Replays a pass into the GL batches ordered by depth. The sort is stable,
+// so primitives within one layer keep the order they were drawn in.
+internal void SubmitDepthPass(render_context* Pass, bool FrontToBack)
+{
+    for (s32 Mode = 0; Mode < R_MODE_COUNT; Mode++)
+    {
+        CloseRenderCommand(Pass, Mode);
+    }
+
+    u32 CommandCount = Pass->CommandCount;
+    if (RenderState.PassOrderCapacity < CommandCount)
+    {
+        RenderState.PassOrderCapacity = CommandCount * 2;
+        RenderState.PassOrder = (u32*)realloc(RenderState.PassOrder, sizeof(u32) * RenderState.PassOrderCapacity);
+    }
+
+    u32* Order = RenderState.PassOrder;
+    for (u32 i = 0; i < CommandCount; i++) Order[i] = i;
+
+    render_command* Commands = Pass->Commands;
+    std::stable_sort(Order, Order + CommandCount, [Commands, FrontToBack](u32 A, u32 B)
+    {
+        f32 DepthA = Commands[A].Key.Depth;
+        f32 DepthB = Commands[B].Key.Depth;
+        return FrontToBack ? DepthA > DepthB : DepthA < DepthB;
+    });
+
+    for (u32 i = 0; i < CommandCount; i++)
+    {
+        render_command* Command = Commands + Order[i];
+        render_batch* Batch = ReserveGLBatch(Command->Mode, Command->Key, Command->VertexCount, Command->IndexCount);
+        CopyRenderCommand(Pass, Command, Batch);
+    }
+
+    FlushRenderBatches();
+    ResetRenderContext(Pass);
+}
+
+// GL_LEQUAL lets a later primitive of the same layer replace an earlier
+// one, as it would without depth testing.
+internal void DrawDepthPasses()
+{
+    if (!RenderState.DepthPasses) return;
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    SubmitDepthPass(RenderState.Passes + PASS_OPAQUE, true);
+
+    // Translucent primitives are hidden by opaque ones in front of them,
+    // but never by each other
+    glDepthMask(GL_FALSE);
+    SubmitDepthPass(RenderState.Passes + PASS_TRANSLUCENT, false);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+}
+
+// Adds the results of finished sample queries to the stats. With Wait the
+// oldest one is read even if that stalls.
+internal void CollectSampleQueries(bool Wait)
+{
+    while (RenderState.QueriesRead != RenderState.QueriesBegun)
+    {
+        u32 Query = RenderState.SampleQueries[RenderState.QueriesRead % RENDER_MAX_FRAMES_IN_FLIGHT];
+
+        GLuint Available = Wait;
+        if (!Wait) glGetQueryObjectuiv(Query, GL_QUERY_RESULT_AVAILABLE, &Available);
+        if (!Available) break;
+
+        GLuint Samples = 0;
+        glGetQueryObjectuiv(Query, GL_QUERY_RESULT, &Samples);
+        RenderState.Stats.SamplesPassed += Samples;
+        RenderState.QueriesRead++;
+        Wait = false;
+    }
+}
+
+// Every frame counts the samples that pass the depth test, i.e. the
+// fragments that were shaded and written. Results are picked up frames
+// later, so they land in the stats of whichever frame reads them.
+internal void BeginSampleQuery()
+{
+    CollectSampleQueries(RenderState.QueriesBegun - RenderState.QueriesRead == RENDER_MAX_FRAMES_IN_FLIGHT);
+    glBeginQuery(GL_SAMPLES_PASSED, RenderState.SampleQueries[RenderState.QueriesBegun % RENDER_MAX_FRAMES_IN_FLIGHT]);
+}
+
+internal void EndSampleQuery()
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    RenderState.QueriesBegun++;
+}
+
+/*
+================================
+Render Thread
+================================
+*/
+
+internal bool PushPacket(packet_queue* Queue, frame_packet* Packet)
+{
+    u32 Tail = Queue->Tail.load(std::memory_order_relaxed);
+    if (Tail - Queue->Head.load(std::memory_order_acquire) == RENDER_PACKET_QUEUE_SIZE) return false;
+
+    Queue->Slots[Tail % RENDER_PACKET_QUEUE_SIZE] = Packet;
+    Queue->Tail.store(Tail + 1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> Guard(Queue->SleepLock);
+    }
+    Queue->WakeUp.notify_one();
+    return true;
+}
+
+internal frame_packet* PopPacket(packet_queue* Queue)
+{
+    u32 Head = Queue->Head.load(std::memory_order_relaxed);
+    if (Head == Queue->Tail.load(std::memory_order_acquire)) return 0;
+
+    frame_packet* Packet = Queue->Slots[Head % RENDER_PACKET_QUEUE_SIZE];
+    Queue->Head.store(Head + 1, std::memory_order_release);
+    return Packet;
+}
+
+// Sleeps until a packet arrives. Returns 0 once the render thread has been
+// stopped and the queue is drained.
+internal frame_packet* WaitPacket(packet_queue* Queue, std::atomic<bool>* Running)
+{
+    for (;;)
+    {
+        frame_packet* Packet = PopPacket(Queue);
+        if (Packet) return Packet;
+
+        std::unique_lock<std::mutex> Lock(Queue->SleepLock);
+        Queue->WakeUp.wait(Lock, [Queue, Running] {
+            return Queue->Head.load() != Queue->Tail.load() || !Running->load();
+        });
+        if (Queue->Head.load() == Queue->Tail.load()) return 0;
+    }
+}
+
+internal void ReplayFramePacket(frame_packet* Packet)
+{
+    SetMatrices(Packet->Projection, Packet->ModelView);
+    BeginSampleQuery();
+
+    if (Packet->Clear)
+    {
+        color Color = Packet->ClearColor;
+        glClearColor(Color.R / 255.0f, Color.G / 255.0f, Color.B / 255.0f, Color.A / 255.0f);
+        BindScissor(rect{});
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    SubmitRenderContext(&Packet->Context);
+    FlushRenderBatches();
+    DrawDepthPasses();
+    EndSampleQuery();
+    EndFrameStats();
+}
+
+internal void RenderThreadMain(render_thread* Thread)
+{
+    Thread->MakeCurrent(Thread->User);
+
+    for (;;)
+    {
+        frame_packet* Packet = WaitPacket(&Thread->Submitted, &Thread->Running);
+        if (!Packet) break;
+
+        ReplayFramePacket(Packet);
+        Thread->Present(Thread->User);
+        PushPacket(&Thread->Free, Packet);
+    }
+}
+
+// Blocks until the render thread returns a packet, which is what bounds
+// the number of frames in flight.
+internal frame_packet* AcquireFramePacket(render_thread* Thread)
+{
+    frame_packet* Packet = WaitPacket(&Thread->Free, &Thread->Running);
+
+    Packet->Clear = false;
+    return Packet;
+}
+
+// Moves GL submission to a dedicated thread. The GL context must be released
+// on the calling thread first; MakeCurrent is invoked on the render thread
+// before the first packet and Present after every packet. Create textures
+// and other GL objects before starting the thread.
+global void StartRenderThread(u32 FramesInFlight, render_thread_callback* MakeCurrent, render_thread_callback* Present, void* User)
+{
+    render_thread* Thread = &RenderThread;
+    Thread->FramesInFlight = glm::clamp(FramesInFlight, 1u, (u32)RENDER_MAX_FRAMES_IN_FLIGHT);
+    Thread->MakeCurrent = MakeCurrent;
+    Thread->Present = Present;
+    Thread->User = User;
+    Thread->Recording = 0;
+
+    for (u32 PacketIndex = 0; PacketIndex < Thread->FramesInFlight; PacketIndex++)
+    {
+        ResetRenderContext(&Thread->Packets[PacketIndex].Context);
+        PushPacket(&Thread->Free, Thread->Packets + PacketIndex);
+    }
+
+    Thread->Running = true;
+    Thread->Thread = std::thread(RenderThreadMain, Thread);
+}
+
+// Drains the submitted packets and joins the render thread.
+global void StopRenderThread()
+{
+    render_thread* Thread = &RenderThread;
+    if (!Thread->Running) return;
+
+    {
+        std::lock_guard<std::mutex> Guard(Thread->Submitted.SleepLock);
+        Thread->Running = false;
+    }
+    Thread->Submitted.WakeUp.notify_all();
+    Thread->Thread.join();
+}
+
+/*
+================================
+Renderer
+================================
+*/
+
+template <s32 Mode>
+internal void InitRenderBatch(GLenum DrawMode, shader_variant* Variants)
+{
+    typedef typename batch_format<Mode>::type format;
+
+    render_batch* Batch = &RenderState.RenderBatches[Mode];
+    Batch->Buffer = CreateVertexBuffer<format>(RENDER_BATCH_MAX_CAPACITY, GL_STREAM_DRAW);
+    Batch->Mode = DrawMode;
+    Batch->Instanced = format::Divisor != 0;
+    Batch->Variants = Variants;
+}
+
+// Load is used for the GL entry points outside of 3.3 core (the program
+// binary cache); pass the same loader given to gladLoadGL, or 0.
+global void InitRenderer(s32 Width, s32 Height, GLADloadfunc Load)
+{
+    InitProgramCache(&RenderState.ProgramCache, Load);
+    CreateShaderVariants();
+
+    program_cache* Cache = &RenderState.ProgramCache;
+    printf("Shader programs: %u cached, %u compiled, %.2f ms%s\n", Cache->Hits, Cache->Misses,
+        Cache->Seconds * 1000.0, Cache->Enabled ? "" : " (binary cache unavailable)");
+
+    RenderState.FramebufferWidth = Width;
+    RenderState.FramebufferHeight = Height;
+
+    InitRenderBatch<R_POINTS>(GL_POINTS, RenderState.Variants);
+    InitRenderBatch<R_LINES>(GL_LINES, RenderState.Variants);
+    InitRenderBatch<R_LINE_STRIPS>(GL_LINE_STRIP, RenderState.Variants);
+    InitRenderBatch<R_TRIANGLES>(GL_TRIANGLES, RenderState.Variants);
+    InitRenderBatch<R_TEXTURES>(GL_TRIANGLES, RenderState.Variants);
+    InitRenderBatch<R_THICK_LINES>(GL_TRIANGLE_STRIP, RenderState.LineVariants);
+    InitRenderBatch<R_SHAPES>(GL_TRIANGLE_STRIP, RenderState.ShapeVariants);
+
+    RenderState.PixelsPerUnit = 1.0f;
+    RenderState.CurveTolerance = CURVE_DEFAULT_TOLERANCE;
+
+    // Triangle indices never reach the restart index, so it can stay on
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(RENDER_PRIMITIVE_RESTART);
+
+    // The first batch sets the blend state, whatever GL starts with
+    InvalidateGLStateCache();
+
+    for (s32 Pass = 0; Pass < PASS_COUNT; Pass++)
+    {
+        ResetRenderContext(RenderState.Passes + Pass);
+    }
+    glGenQueries(RENDER_MAX_FRAMES_IN_FLIGHT, RenderState.SampleQueries);
+}
+
+global void BeginFrame()
+{
+    RenderState.FrameIndex++;
+
+    mat4 Projection = glm::ortho(0.0f,
+        (f32)RenderState.FramebufferWidth,
+        (f32)RenderState.FramebufferHeight,
+        0.0f, -1.0f, 1.0f);
+    mat4 ModelView = glm::mat4(1.0f);
+
+    // Curve tolerances are in pixels, so flattening needs the length of a
+    // drawing unit on screen under this frame's matrices
+    mat4 Transform = Projection * ModelView;
+    f32 HalfWidth = RenderState.FramebufferWidth * 0.5f;
+    f32 HalfHeight = RenderState.FramebufferHeight * 0.5f;
+    vec2 AxisX = vec2(Transform[0][0] * HalfWidth, Transform[0][1] * HalfHeight);
+    vec2 AxisY = vec2(Transform[1][0] * HalfWidth, Transform[1][1] * HalfHeight);
+    RenderState.PixelsPerUnit = glm::max(glm::length(AxisX), glm::length(AxisY));
+
+    // With a render thread the matrices travel with the packet, since the
+    // render thread may still be drawing the previous frame.
+    if (RenderThread.Running)
+    {
+        frame_packet* Packet = AcquireFramePacket(&RenderThread);
+        Packet->Projection = Projection;
+        Packet->ModelView = ModelView;
+        RenderThread.Recording = Packet;
+        DefaultContext = &Packet->Context;
+        ActiveContext = DefaultContext;
+        return;
+    }
+
+    SetMatrices(Projection, ModelView);
+    BeginSampleQuery();
+}
+
+// Recording threads must have finished (joined) before this is called.
+global void EndFrame()
+{
+    render_context* Sorted[RENDER_CONTEXT_MAX_COUNT];
+    u32 SortedCount = RenderState.ContextCount;
+
+    for (u32 i = 0; i < SortedCount; i++)
+    {
+        render_context* Context = RenderState.Contexts[i];
+        u32 j = i;
+        for (; j > 0 && Sorted[j - 1]->SortKey > Context->SortKey; j--)
+        {
+            Sorted[j] = Sorted[j - 1];
+        }
+        Sorted[j] = Context;
+    }
+
+    // With a render thread ActiveContext is the frame packet, so the
+    // contexts are merged into it rather than into the GL batches
+    for (u32 i = 0; i < SortedCount; i++)
+    {
+        SubmitRenderContext(Sorted[i]);
+    }
+
+    if (RenderThread.Recording)
+    {
+        PushPacket(&RenderThread.Submitted, RenderThread.Recording);
+        RenderThread.Recording = 0;
+        DefaultContext = 0;
+        ActiveContext = 0;
+        return;
+    }
+
+    FlushRenderBatches();
+    DrawDepthPasses();
+    EndSampleQuery();
+    EndFrameStats();
+}
+
+// Optional shader features (SHADER_ALPHA_TEST, SHADER_PREMULTIPLIED, ...)
+// for the following draws on this thread. SHADER_TEXTURED is implied by
+// textured primitives and does not need to be set here.
+global void SetShaderFeatures(u32 Features)
+{
+    CurrentDrawState()->Features = Features & ~SHADER_TEXTURED;
+}
+
+// Blend mode of the following draws on this thread. Switching flushes the
+// batches recorded so far, so group draws by mode where order allows.
+global void SetBlendMode(blend_mode Blend)
+{
+    CurrentDrawState()->Blend = Blend;
+}
+
+// Layer of the following draws on this thread. Without depth passes layers
+// only matter to the depth buffer; with them, higher layers hide lower ones
+// whatever order they were drawn in.
+global void SetDrawLayer(s32 Layer)
+{
+    Layer = glm::clamp(Layer, -RENDER_MAX_LAYER, RENDER_MAX_LAYER);
+    CurrentDrawState()->Depth = (f32)Layer / (RENDER_MAX_LAYER + 1);
+}
+
+// Defers every draw of the frame into an opaque and a translucent pass
+// (see render_pass). Opaque means BLEND_OPAQUE, so sprites without
+// transparency should be drawn with that mode, plus SHADER_ALPHA_TEST for
+// cutouts. The window needs a depth buffer. Call between frames.
+global void SetDepthPasses(bool Enabled)
+{
+    RenderState.DepthPasses = Enabled;
+}
+
+// Vertices are stored relative to this point and the shader adds it back.
+// With RENDER_COMPACT_VERTICES positions have to stay within 32k pixels of
+// it, so move it along when drawing far from (0, 0).
+global void SetBatchOrigin(s32 X, s32 Y)
+{
+    draw_state* State = CurrentDrawState();
+    State->OriginX = X;
+    State->OriginY = Y;
+}
+
+// Limits the following draws on this thread to Clip, intersected with the
+// enclosing clip rect. Coordinates are pixels like every Draw* call.
+global void PushClipRect(const rect& Clip)
+{
+    draw_state* State = CurrentDrawState();
+    const rect* Outer = CurrentClip();
+    State->ClipDepth++;
+    if (State->ClipDepth > RENDER_MAX_CLIP_DEPTH) return;
+
+    rect Result = Clip;
+    if (Outer)
+    {
+        s32 MinX = glm::max(Clip.X, Outer->X);
+        s32 MinY = glm::max(Clip.Y, Outer->Y);
+        s32 MaxX = glm::min(Clip.X + Clip.Width, Outer->X + Outer->Width);
+        s32 MaxY = glm::min(Clip.Y + Clip.Height, Outer->Y + Outer->Height);
+        Result = { MinX, MinY, glm::max(MaxX - MinX, 0), glm::max(MaxY - MinY, 0) };
+    }
+    State->ClipStack[State->ClipDepth - 1] = Result;
+}
+
+global void PopClipRect()
+{
+    draw_state* State = CurrentDrawState();
+    if (State->ClipDepth) State->ClipDepth--;
+}
+
+global void ClearScreen(color Color)
+{
+    if (RenderThread.Recording)
+    {
+        RenderThread.Recording->ClearColor = Color;
+        RenderThread.Recording->Clear = true;
+        return;
+    }
+
+    // The scissor would limit the clear as well
+    glClearColor(Color.R / 255.0f, Color.G / 255.0f, Color.B / 255.0f, Color.A / 255.0f);
+    BindScissor(rect{});
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+global void DrawPoint(s32 X, s32 Y, color Color)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipBatchKey(&Key, (f32)X, (f32)Y, (f32)X, (f32)Y)) return;
+    render_batch *RenderBatch = ReserveBatch(R_POINTS, Key, 1, 0);
+    vertex_input Vertex = { BatchPosition(Key, X, Y), vec2(0.0f), Color };
+    PushVertex<R_POINTS>(RenderBatch, Vertex);
+}
+
+global void DrawLine(s32 X1, s32 Y1, s32 X2, s32 Y2, color Color)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipBatchKey(&Key, (f32)glm::min(X1, X2), (f32)glm::min(Y1, Y2), (f32)glm::max(X1, X2), (f32)glm::max(Y1, Y2))) return;
+    render_batch *RenderBatch = ReserveBatch(R_LINES, Key, 2, 0);
+    vertex_input V1 = { BatchPosition(Key, X1, Y1), vec2(0.0f), Color };
+    vertex_input V2 = { BatchPosition(Key, X2, Y2), vec2(0.0f), Color };
+    PushVertex<R_LINES>(RenderBatch, V1);
+    PushVertex<R_LINES>(RenderBatch, V2);
+}
+
+global void DrawRectLines(s32 X, s32 Y, s32 Width, s32 Height, color Color)
+{
+    ivec2 Factors[] = {
+        { 0, 0 }, { 1, 0 },
+        { 1, 0 }, { 1, 1 },
+        { 1, 1 }, { 0, 1 },
+        { 0, 1 }, { 0, 0 }
+    };
+
+    for (s32 FactorIndex = 0; FactorIndex < 8; FactorIndex += 2)
+    {
+        s32 X1 = X + Width  * Factors[FactorIndex + 0][0];
+        s32 Y1 = Y + Height * Factors[FactorIndex + 0][1];
+        s32 X2 = X + Width  * Factors[FactorIndex + 1][0];
+        s32 Y2 = Y + Height * Factors[FactorIndex + 1][1];
+
+        DrawLine(X1, Y1, X2, Y2, Color);
+    }
+}
+
+// Appends one strip followed by a restart index. A strip longer than a
+// batch continues in the next one from its last point.
+internal void PushLineStrip(batch_key Key, const vec2* Points, u32 Count, color Color, bool Closed)
+{
+    u32 StripLength = Closed ? Count + 1 : Count;
+    u32 First = 0;
+
+    while (StripLength - First >= 2)
+    {
+        u32 WindowCount = glm::min(StripLength - First, (u32)RENDER_BATCH_MAX_CAPACITY);
+        render_batch* RenderBatch = ReserveBatch(R_LINE_STRIPS, Key, WindowCount, WindowCount + 1);
+        vertex_buffer* Buffer = &RenderBatch->Buffer;
+        u32* Indices = Buffer->Indices + Buffer->ElementCount;
+
+        for (u32 i = 0; i < WindowCount; i++)
+        {
+            vec2 Point = Points[(First + i) % Count];
+            vertex_input Vertex = { BatchPosition(Key, Point.x, Point.y), vec2(0.0f), Color };
+            Indices[i] = Buffer->VertexCount;
+            PushVertex<R_LINE_STRIPS>(RenderBatch, Vertex);
+        }
+
+        Indices[WindowCount] = RENDER_PRIMITIVE_RESTART;
+        Buffer->ElementCount += WindowCount + 1;
+
+        if (First + WindowCount == StripLength) break;
+        First += WindowCount - 1;
+    }
+}
+
+// One-pixel line through Count points. Unlike a DrawLine per segment,
+// every point is stored once, and consecutive polylines share a draw call.
+global void DrawPolyline(const vec2* Points, u32 Count, color Color, bool Closed = false)
+{
+    if (Count < 2) return;
+
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipPointsKey(&Key, Points, Count, 0.0f)) return;
+    PushLineStrip(Key, Points, Count, Color, Closed);
+}
+
+// SeriesCount polylines stored back to back in Points, Counts[i] points
+// and Colors[i] for series i, e.g. the lines of a chart.
+global void DrawPolylines(const vec2* Points, const u32* Counts, const color* Colors, u32 SeriesCount)
+{
+    u32 PointCount = 0;
+    for (u32 Series = 0; Series < SeriesCount; Series++) PointCount += Counts[Series];
+
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipPointsKey(&Key, Points, PointCount, 0.0f)) return;
+
+    for (u32 Series = 0; Series < SeriesCount; Series++)
+    {
+        if (Counts[Series] >= 2) PushLineStrip(Key, Points, Counts[Series], Colors[Series], false);
+        Points += Counts[Series];
+    }
+}
+
+global void DrawRect(s32 X, s32 Y, s32 Width, s32 Height, color Color)
+{
+    f32 X0 = (f32)X;
+    f32 Y0 = (f32)Y;
+    f32 X1 = (f32)(X + Width);
+    f32 Y1 = (f32)(Y + Height);
+
+    const rect* Clip = CurrentClip();
+    if (Clip)
+    {
+        f32 U0 = 0.0f, V0 = 0.0f, U1 = 0.0f, V1 = 0.0f;
+        if (!ClipQuad(*Clip, &X0, &Y0, &X1, &Y1, &U0, &V0, &U1, &V1)) return;
+    }
+
+    batch_key Key = MakeBatchKey(0);
+    render_batch* RenderBatch = ReserveBatch(R_TRIANGLES, Key, 4, 6);
+
+    vec2 Vertices[] = {
+        BatchPosition(Key, X0, Y0),
+        BatchPosition(Key, X0, Y1),
+        BatchPosition(Key, X1, Y1),
+        BatchPosition(Key, X1, Y0)
+    };
+
+    u32 Indices[] = {
+        RenderBatch->Buffer.VertexCount + 0,
+        RenderBatch->Buffer.VertexCount + 1,
+        RenderBatch->Buffer.VertexCount + 2,
+        RenderBatch->Buffer.VertexCount + 0,
+        RenderBatch->Buffer.VertexCount + 2,
+        RenderBatch->Buffer.VertexCount + 3
+    };
+
+    for (s32 i = 0; i < 4; i++)
+    {
+        vertex_input Vertex = { Vertices[i], vec2(0.0f), Color };
+        PushVertex<R_TRIANGLES>(RenderBatch, Vertex);
+    }
+
+    PushIndex(RenderBatch, Indices, 6);
+}
+
+global void DrawTexture(texture* Texture, const rect& SrcRect, const rect& DstRect, color Color)
+{
+    f32 X0 = (f32)DstRect.X;
+    f32 Y0 = (f32)DstRect.Y;
+    f32 X1 = (f32)(DstRect.X + DstRect.Width);
+    f32 Y1 = (f32)(DstRect.Y + DstRect.Height);
+
+    f32 U0 = (f32)SrcRect.X / Texture->Width;
+    f32 V0 = (f32)SrcRect.Y / Texture->Height;
+    f32 U1 = (f32)(SrcRect.X + SrcRect.Width) / Texture->Width;
+    f32 V1 = (f32)(SrcRect.Y + SrcRect.Height) / Texture->Height;
+
+    const rect* Clip = CurrentClip();
+    if (Clip && !ClipQuad(*Clip, &X0, &Y0, &X1, &Y1, &U0, &V0, &U1, &V1)) return;
+
+    batch_key Key = MakeBatchKey(Texture->Handle);
+    render_batch* RenderBatch = ReserveBatch(R_TEXTURES, Key, 4, 6);
+
+    vec2 Vertices[] = {
+        BatchPosition(Key, X0, Y0),
+        BatchPosition(Key, X0, Y1),
+        BatchPosition(Key, X1, Y1),
+        BatchPosition(Key, X1, Y0)
+    };
+
+    vec2 TexCoord[4] = {
+        { U0, V0 },
+        { U0, V1 },
+        { U1, V1 },
+        { U1, V0 }
+    };
+
+    u32 Indices[] = {
+        RenderBatch->Buffer.VertexCount + 0,
+        RenderBatch->Buffer.VertexCount + 1,
+        RenderBatch->Buffer.VertexCount + 2,
+        RenderBatch->Buffer.VertexCount + 0,
+        RenderBatch->Buffer.VertexCount + 2,
+        RenderBatch->Buffer.VertexCount + 3
+    };
+
+    for (s32 i = 0; i < 4; i++)
+    {
+        vertex_input Vertex = { Vertices[i], TexCoord[i], Color };
+        PushVertex<R_TEXTURES>(RenderBatch, Vertex);
+    }
+
+    PushIndex(RenderBatch, Indices, 6);
+}
+
+/*
+================================
+Nine Slice
+================================
+*/
+
+// Texture coordinates of the four grid lines in each direction.
+struct nine_slice_uvs
+{
+    f32 U[4];
+    f32 V[4];
+};
+
+internal nine_slice_uvs MakeNineSliceUVs(texture* Texture, const rect& SrcRect, const borders& Borders)
+{
+    f32 InvWidth = 1.0f / Texture->Width;
+    f32 InvHeight = 1.0f / Texture->Height;
+
+    nine_slice_uvs Result = {};
+    Result.U[0] = SrcRect.X * InvWidth;
+    Result.U[1] = (SrcRect.X + Borders.Left) * InvWidth;
+    Result.U[2] = (SrcRect.X + SrcRect.Width - Borders.Right) * InvWidth;
+    Result.U[3] = (SrcRect.X + SrcRect.Width) * InvWidth;
+    Result.V[0] = SrcRect.Y * InvHeight;
+    Result.V[1] = (SrcRect.Y + Borders.Top) * InvHeight;
+    Result.V[2] = (SrcRect.Y + SrcRect.Height - Borders.Bottom) * InvHeight;
+    Result.V[3] = (SrcRect.Y + SrcRect.Height) * InvHeight;
+    return Result;
+}
+
+// Writes a 4x4 vertex grid and the 54 indices of its nine quads at the end
+// of Buffer, which must have room for them. A panel smaller than its two
+// borders shrinks them in proportion. With a clip rect the grid lines are
+// clamped to it, and a panel outside it writes nothing.
+internal void PushNineSlice(vertex_buffer* Buffer, const batch_key& Key, nine_slice_uvs UVs, const borders& Borders, const rect& DstRect, color Color, const rect* Clip)
+{
+    typedef batch_format<R_TEXTURES>::type format;
+
+    f32 ScaleX = 1.0f;
+    f32 ScaleY = 1.0f;
+    if (Borders.Left + Borders.Right > DstRect.Width) ScaleX = (f32)DstRect.Width / glm::max(Borders.Left + Borders.Right, 1);
+    if (Borders.Top + Borders.Bottom > DstRect.Height) ScaleY = (f32)DstRect.Height / glm::max(Borders.Top + Borders.Bottom, 1);
+
+    f32 MinX = (f32)DstRect.X;
+    f32 MinY = (f32)DstRect.Y;
+    f32 X[4] = { MinX, MinX + Borders.Left * ScaleX, MinX + DstRect.Width - Borders.Right * ScaleX, MinX + DstRect.Width };
+    f32 Y[4] = { MinY, MinY + Borders.Top * ScaleY, MinY + DstRect.Height - Borders.Bottom * ScaleY, MinY + DstRect.Height };
+
+    if (Clip)
+    {
+        if (!ClipGridLines((f32)Clip->X, (f32)(Clip->X + Clip->Width), X, UVs.U)) return;
+        if (!ClipGridLines((f32)Clip->Y, (f32)(Clip->Y + Clip->Height), Y, UVs.V)) return;
+    }
+
+    for (s32 i = 0; i < 4; i++)
+    {
+        X[i] -= Key.OriginX;
+        Y[i] -= Key.OriginY;
+    }
+
+    u32 Base = Buffer->VertexCount;
+    u8* Vertex = Buffer->Vertices + Base * format::Stride;
+
+    for (s32 Row = 0; Row < 4; Row++)
+    {
+        for (s32 Column = 0; Column < 4; Column++)
+        {
+            vertex_input Input = { vec2(X[Column], Y[Row]), vec2(UVs.U[Column], UVs.V[Row]), Color };
+            format::Write(Vertex, Input);
+            Vertex += format::Stride;
+        }
+    }
+
+    // Same winding as DrawTexture: top-left, bottom-left, bottom-right
+    u32* Indices = Buffer->Indices + Buffer->ElementCount;
+    for (u32 Row = 0; Row < 3; Row++)
+    {
+        for (u32 Column = 0; Column < 3; Column++)
+        {
+            u32 TopLeft = Base + Row * 4 + Column;
+            Indices[0] = TopLeft;
+            Indices[1] = TopLeft + 4;
+            Indices[2] = TopLeft + 5;
+            Indices[3] = TopLeft;
+            Indices[4] = TopLeft + 5;
+            Indices[5] = TopLeft + 1;
+            Indices += 6;
+        }
+    }
+
+    Buffer->VertexCount += 16;
+    Buffer->ElementCount += 54;
+}
+
+// Stretches SrcRect over DstRect with its borders kept at their texel
+// size, as one 16 vertex grid in the textured batch.
+global void DrawNineSlice(texture* Texture, const rect& SrcRect, const borders& Borders, const rect& DstRect, color Color)
+{
+    batch_key Key = MakeBatchKey(Texture->Handle);
+    render_batch* RenderBatch = ReserveBatch(R_TEXTURES, Key, 16, 54);
+    PushNineSlice(&RenderBatch->Buffer, Key, MakeNineSliceUVs(Texture, SrcRect, Borders), Borders, DstRect, Color, CurrentClip());
+}
+
+// Count panels sharing one skin, e.g. every window of a UI. The texture
+// coordinates are computed once for all of them.
+global void DrawNineSlices(texture* Texture, const rect& SrcRect, const borders& Borders, const rect* DstRects, const color* Colors, u32 Count)
+{
+    u32 PanelsPerWindow = glm::min(RENDER_BATCH_MAX_CAPACITY / 16, RENDER_BATCH_MAX_INDICES / 54);
+    batch_key Key = MakeBatchKey(Texture->Handle);
+    nine_slice_uvs UVs = MakeNineSliceUVs(Texture, SrcRect, Borders);
+    const rect* Clip = CurrentClip();
+
+    for (u32 First = 0; First < Count; First += PanelsPerWindow)
+    {
+        u32 WindowCount = glm::min(Count - First, PanelsPerWindow);
+        render_batch* RenderBatch = ReserveBatch(R_TEXTURES, Key, WindowCount * 16, WindowCount * 54);
+
+        for (u32 i = First; i < First + WindowCount; i++)
+        {
+            PushNineSlice(&RenderBatch->Buffer, Key, UVs, Borders, DstRects[i], Colors[i], Clip);
+        }
+    }
+}
+
+/*
+================================
+Thick Lines
+================================
+*/
+
+// Shear of a joined end, in half widths along the segment, that puts the
+// quad's corners on the miter line between directions In and Out. Sharp
+// turns are limited like SVG's default miter limit of 4.
+internal f32 MiterShear(vec2 In, vec2 Out, vec2 Dir)
+{
+    vec2 Normal = vec2(-Dir.y, Dir.x);
+    vec2 Miter = vec2(-In.y - Out.y, In.x + Out.x);
+    f32 Length = glm::length(Miter);
+    if (Length < 1e-6f) return 0.0f;
+
+    Miter /= Length;
+    f32 Shear = glm::dot(Miter, Dir) / glm::max(glm::dot(Miter, Normal), 0.25f);
+    return glm::clamp(Shear, -4.0f, 4.0f);
+}
+
+internal void PushLineInstance(render_batch* Batch, const batch_key& Key, vec2 Start, vec2 End, f32 Width, f32 StartMiter, f32 EndMiter, u32 Flags, color Color)
+{
+    line_input Input = {};
+    Input.Start = BatchPosition(Key, Start.x, Start.y);
+    Input.End = BatchPosition(Key, End.x, End.y);
+    Input.HalfWidth = Width * 0.5f;
+    Input.StartMiter = StartMiter;
+    Input.EndMiter = EndMiter;
+    Input.Flags = Flags;
+    Input.Color = Color;
+    PushVertex<R_THICK_LINES>(Batch, Input);
+}
+
+// Anti-aliased line of any width. Unlike DrawLine this is one instance of
+// a single instanced draw, however many segments the frame has.
+global void DrawThickLine(f32 X1, f32 Y1, f32 X2, f32 Y2, f32 Width, color Color, bool RoundCaps = false)
+{
+    batch_key Key = MakeBatchKey(0);
+    f32 Pad = Width * 0.5f;
+    if (!ClipBatchKey(&Key, fminf(X1, X2) - Pad, fminf(Y1, Y2) - Pad, fmaxf(X1, X2) + Pad, fmaxf(Y1, Y2) + Pad)) return;
+    render_batch* RenderBatch = ReserveBatch(R_THICK_LINES, Key, 1, 0);
+    PushLineInstance(RenderBatch, Key, vec2(X1, Y1), vec2(X2, Y2), Width, 0.0f, 0.0f, RoundCaps ? LINE_ROUND : 0, Color);
+}
+
+// Independent segments: Points holds two endpoints per segment and Colors
+// one color per segment.
+global void DrawThickLines(const vec2* Points, const color* Colors, u32 SegmentCount, f32 Width, bool RoundCaps = false)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipPointsKey(&Key, Points, SegmentCount * 2, Width * 0.5f)) return;
+    u32 Flags = RoundCaps ? LINE_ROUND : 0;
+
+    for (u32 First = 0; First < SegmentCount; First += RENDER_BATCH_MAX_CAPACITY)
+    {
+        u32 WindowCount = glm::min(SegmentCount - First, (u32)RENDER_BATCH_MAX_CAPACITY);
+        render_batch* RenderBatch = ReserveBatch(R_THICK_LINES, Key, WindowCount, 0);
+
+        for (u32 i = First; i < First + WindowCount; i++)
+        {
+            PushLineInstance(RenderBatch, Key, Points[i * 2], Points[i * 2 + 1], Width, 0.0f, 0.0f, Flags, Colors[i]);
+        }
+    }
+}
+
+// Connected segments through Count points. Miter joins meet exactly on the
+// bisector; round joins are capsules, so with translucent colors the
+// overlap at each joint is blended twice. Open ends get butt caps for
+// miter joins and round caps for round joins.
+global void DrawThickPolyline(const vec2* Points, u32 Count, f32 Width, color Color, line_join Join, bool Closed = false)
+{
+    if (Count < 2) return;
+
+    u32 SegmentCount = Closed ? Count : Count - 1;
+
+    // Miters reach out up to four half widths
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipPointsKey(&Key, Points, Count, Width * 2.0f)) return;
+
+    for (u32 Segment = 0; Segment < SegmentCount; Segment++)
+    {
+        render_batch* RenderBatch = ReserveBatch(R_THICK_LINES, Key, 1, 0);
+
+        vec2 Start = Points[Segment];
+        vec2 End = Points[(Segment + 1) % Count];
+
+        if (Join == LINE_JOIN_ROUND)
+        {
+            PushLineInstance(RenderBatch, Key, Start, End, Width, 0.0f, 0.0f, LINE_ROUND, Color);
+            continue;
+        }
+
+        vec2 Delta = End - Start;
+        f32 Length = glm::length(Delta);
+        vec2 Dir = Length > 0.0f ? Delta / Length : vec2(1.0f, 0.0f);
+
+        u32 Flags = 0;
+        f32 StartMiter = 0.0f;
+        f32 EndMiter = 0.0f;
+
+        if (Closed || Segment > 0)
+        {
+            vec2 Previous = Points[(Segment + Count - 1) % Count];
+            vec2 In = Start - Previous;
+            f32 InLength = glm::length(In);
+            if (InLength > 0.0f)
+            {
+                StartMiter = MiterShear(In / InLength, Dir, Dir);
+                Flags |= LINE_START_JOINED;
+            }
+        }
+
+        if (Closed || Segment + 2 < Count)
+        {
+            vec2 Next = Points[(Segment + 2) % Count];
+            vec2 Out = Next - End;
+            f32 OutLength = glm::length(Out);
+            if (OutLength > 0.0f)
+            {
+                EndMiter = MiterShear(Dir, Out / OutLength, Dir);
+                Flags |= LINE_END_JOINED;
+            }
+        }
+
+        PushLineInstance(RenderBatch, Key, Start, End, Width, StartMiter, EndMiter, Flags, Color);
+    }
+}
+
+/*
+================================
+Shapes
+================================
+*/
+
+// Thickness 0 fills the shape, anything else draws an outline that wide
+// inside its edge. The corner radius is clamped to the shape's half size.
+internal void PushShape(f32 CenterX, f32 CenterY, f32 HalfWidth, f32 HalfHeight, f32 Radius, f32 Thickness, color Color)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ClipBatchKey(&Key, CenterX - HalfWidth, CenterY - HalfHeight, CenterX + HalfWidth, CenterY + HalfHeight)) return;
+    render_batch* RenderBatch = ReserveBatch(R_SHAPES, Key, 1, 0);
+
+    shape_input Input = {};
+    Input.Center = BatchPosition(Key, CenterX, CenterY);
+    Input.HalfSize = vec2(HalfWidth, HalfHeight);
+    Input.Radius = glm::clamp(Radius, 0.0f, glm::min(HalfWidth, HalfHeight));
+    Input.Thickness = Thickness;
+    Input.Color = Color;
+    PushVertex<R_SHAPES>(RenderBatch, Input);
+}
+
+global void DrawCircle(f32 X, f32 Y, f32 Radius, color Color)
+{
+    PushShape(X, Y, Radius, Radius, Radius, 0.0f, Color);
+}
+
+global void DrawRing(f32 X, f32 Y, f32 Radius, f32 Thickness, color Color)
+{
+    PushShape(X, Y, Radius, Radius, Radius, glm::max(Thickness, 0.0f), Color);
+}
+
+// Same placement as DrawRect: X and Y are the top-left corner.
+global void DrawRoundedRect(f32 X, f32 Y, f32 Width, f32 Height, f32 CornerRadius, color Color)
+{
+    PushShape(X + Width * 0.5f, Y + Height * 0.5f, Width * 0.5f, Height * 0.5f, CornerRadius, 0.0f, Color);
+}
+
+/*
+================================
+Curves
+================================
+*/
+
+// Curves are flattened on the CPU into as few chords as keep every point
+// of the curve within RenderState.CurveTolerance pixels of them, and drawn
+// as a line strip, or as a thick polyline when Width is above 0.
+
+global thread_local vec2* CurveScratch;
+global thread_local u32 CurveScratchCapacity;
+
+internal vec2* GetCurveScratch(u32 Count)
+{
+    if (Count > CurveScratchCapacity)
+    {
+        CurveScratchCapacity = glm::max(Count, CurveScratchCapacity * 2);
+        CurveScratch = (vec2*)realloc(CurveScratch, sizeof(vec2) * CurveScratchCapacity);
+    }
+    return CurveScratch;
+}
+
+// Maximum distance in pixels between a curve and its flattened chords.
+global void SetCurveTolerance(f32 Pixels)
+{
+    RenderState.CurveTolerance = glm::max(Pixels, 0.01f);
+}
+
+// Wang's formula: Degree * (Degree - 1) / 8 * Bend / Segments^2 bounds the
+// chord error of a Bezier curve, where Bend is the longest second
+// difference of its control points.
+internal u32 BezierSegments(f32 Bend, f32 Degree)
+{
+    f32 Tolerance = RenderState.CurveTolerance / RenderState.PixelsPerUnit;
+    f32 Segments = sqrtf(Degree * (Degree - 1.0f) * Bend / (8.0f * Tolerance));
+    return glm::clamp((u32)ceilf(Segments), 1u, (u32)CURVE_MAX_SEGMENTS);
+}
+
+// Writes Segments + 1 points of ((A t + B) t + C) t + D for evenly spaced
+// t in 0..1, four at a time.
+internal void EvaluateCurve(vec2 A, vec2 B, vec2 C, vec2 D, u32 Segments, vec2* Points)
+{
+    __m128 Ax = _mm_set1_ps(A.x), Ay = _mm_set1_ps(A.y);
+    __m128 Bx = _mm_set1_ps(B.x), By = _mm_set1_ps(B.y);
+    __m128 Cx = _mm_set1_ps(C.x), Cy = _mm_set1_ps(C.y);
+    __m128 Dx = _mm_set1_ps(D.x), Dy = _mm_set1_ps(D.y);
+    __m128 Ramp = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128 Step = _mm_set1_ps(1.0f / Segments);
+
+    u32 Count = Segments + 1;
+    u32 i = 0;
+
+    for (; i + 4 <= Count; i += 4)
+    {
+        __m128 T = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((f32)i), Ramp), Step);
+        __m128 X = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(Ax, T), Bx), T), Cx), T), Dx);
+        __m128 Y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(Ay, T), By), T), Cy), T), Dy);
+
+        _mm_storeu_ps(&Points[i].x, _mm_unpacklo_ps(X, Y));
+        _mm_storeu_ps(&Points[i + 2].x, _mm_unpackhi_ps(X, Y));
+    }
+
+    for (; i < Count; i++)
+    {
+        f32 T = (f32)i / Segments;
+        Points[i] = ((A * T + B) * T + C) * T + D;
+    }
+}
+
+// Both return the number of points written, at most CURVE_MAX_SEGMENTS + 1.
+internal u32 FlattenQuadratic(vec2 P0, vec2 P1, vec2 P2, vec2* Points)
+{
+    vec2 Bend = P0 - P1 * 2.0f + P2;
+    u32 Segments = BezierSegments(glm::length(Bend), 2.0f);
+
+    EvaluateCurve(vec2(0.0f), Bend, (P1 - P0) * 2.0f, P0, Segments, Points);
+    Points[Segments] = P2;
+    return Segments + 1;
+}
+
+internal u32 FlattenCubic(vec2 P0, vec2 P1, vec2 P2, vec2 P3, vec2* Points)
+{
+    f32 Bend = glm::max(glm::length(P0 - P1 * 2.0f + P2), glm::length(P1 - P2 * 2.0f + P3));
+    u32 Segments = BezierSegments(Bend, 3.0f);
+
+    vec2 A = P3 - P0 + (P1 - P2) * 3.0f;
+    vec2 B = (P0 - P1 * 2.0f + P2) * 3.0f;
+    vec2 C = (P1 - P0) * 3.0f;
+    EvaluateCurve(A, B, C, P0, Segments, Points);
+    Points[Segments] = P3;
+    return Segments + 1;
+}
+
+internal void DrawFlattened(batch_key Key, const vec2* Points, u32 Count, color Color, f32 Width, bool Closed)
+{
+    if (Width > 0.0f) DrawThickPolyline(Points, Count, Width, Color, LINE_JOIN_MITER, Closed);
+    else if (ClipPointsKey(&Key, Points, Count, 0.0f)) PushLineStrip(Key, Points, Count, Color, Closed);
+}
+
+global void DrawQuadraticBezier(vec2 P0, vec2 P1, vec2 P2, color Color, f32 Width = 0.0f)
+{
+    vec2* Points = GetCurveScratch(CURVE_MAX_SEGMENTS + 1);
+    u32 Count = FlattenQuadratic(P0, P1, P2, Points);
+    DrawFlattened(MakeBatchKey(0), Points, Count, Color, Width, false);
+}
+
+global void DrawCubicBezier(vec2 P0, vec2 P1, vec2 P2, vec2 P3, color Color, f32 Width = 0.0f)
+{
+    vec2* Points = GetCurveScratch(CURVE_MAX_SEGMENTS + 1);
+    u32 Count = FlattenCubic(P0, P1, P2, P3, Points);
+    DrawFlattened(MakeBatchKey(0), Points, Count, Color, Width, false);
+}
+
+// CurveCount independent cubics, four control points each. Every curve
+// gets its own segment count, and 1-pixel curves all share one batch key.
+global void DrawCubicBeziers(const vec2* ControlPoints, u32 CurveCount, color Color, f32 Width = 0.0f)
+{
+    vec2* Points = GetCurveScratch(CURVE_MAX_SEGMENTS + 1);
+    batch_key Key = MakeBatchKey(0);
+
+    for (u32 Curve = 0; Curve < CurveCount; Curve++)
+    {
+        const vec2* P = ControlPoints + Curve * 4;
+        u32 Count = FlattenCubic(P[0], P[1], P[2], P[3], Points);
+        DrawFlattened(Key, Points, Count, Color, Width, false);
+    }
+}
+
+// Writes the chords of an arc of Sweep radians, at most CURVE_MAX_SEGMENTS
+// + 1 points. The chord's sagitta r * (1 - cos(Step / 2)) is its distance
+// from the arc, measured on the outer edge of a stroke Width wide.
+internal u32 FlattenArc(vec2 Center, f32 Radius, f32 StartAngle, f32 Sweep, f32 Width, bool Closed, vec2* Points)
+{
+    f32 PixelRadius = (Radius + Width * 0.5f) * RenderState.PixelsPerUnit;
+    f32 Step = 3.1415927f;
+    if (PixelRadius > RenderState.CurveTolerance)
+    {
+        Step = 2.0f * acosf(1.0f - RenderState.CurveTolerance / PixelRadius);
+    }
+
+    u32 Segments = glm::clamp((u32)ceilf(fabsf(Sweep) / Step), Closed ? 3u : 1u, (u32)CURVE_MAX_SEGMENTS);
+    u32 Count = Closed ? Segments : Segments + 1;
+
+    for (u32 i = 0; i < Count; i++)
+    {
+        f32 Angle = StartAngle + Sweep * i / Segments;
+        Points[i] = Center + vec2(cosf(Angle), sinf(Angle)) * Radius;
+    }
+    return Count;
+}
+
+// Angles are in radians, clockwise on screen since y points down. A sweep
+// of a full turn or more draws a closed circle.
+global void DrawArc(vec2 Center, f32 Radius, f32 StartAngle, f32 EndAngle, color Color, f32 Width = 0.0f)
+{
+    f32 Sweep = EndAngle - StartAngle;
+    bool Closed = fabsf(Sweep) >= 6.2831853f;
+    if (Closed) Sweep = 6.2831853f;
+
+    vec2* Points = GetCurveScratch(CURVE_MAX_SEGMENTS + 1);
+    u32 Count = FlattenArc(Center, Radius, StartAngle, Sweep, Width, Closed, Points);
+    DrawFlattened(MakeBatchKey(0), Points, Count, Color, Width, Closed);
+}
+
+/*
+================================
+Bulk Draw
+================================
+*/
+
+// Bulk draws reserve one window of the batch per iteration and let the job
+// system expand the vertices into disjoint ranges of it in parallel.
+
+struct bulk_point_job
+{
+    vertex_buffer* Buffer;
+    u32 FirstVertex;
+    const f32* X;
+    const f32* Y;
+    u32 PositionStride;
+    f32 PositionScale;
+    const color* Colors;
+    f32 OriginX;
+    f32 OriginY;
+};
+
+internal void FillPointsJob(void* Data, u32 Start, u32 End)
+{
+    typedef batch_format<R_POINTS>::type format;
+
+    bulk_point_job* Job = (bulk_point_job*)Data;
+    u8* Vertex = Job->Buffer->Vertices + (Job->FirstVertex + Start) * format::Stride;
+
+    vertex_input Input = {};
+
+    for (u32 i = Start; i < End; i++)
+    {
+        Input.Position.x = Job->X[i * Job->PositionStride] * Job->PositionScale - Job->OriginX;
+        Input.Position.y = Job->Y[i * Job->PositionStride] * Job->PositionScale - Job->OriginY;
+        Input.Color = Job->Colors[i];
+        format::Write(Vertex, Input);
+        Vertex += format::Stride;
+    }
+}
+
+internal void DrawPointsStrided(const f32* X, const f32* Y, u32 Stride, f32 Scale, const color* Colors, u32 Count)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ScissorBatchKey(&Key)) return;
+
+    for (u32 First = 0; First < Count; First += RENDER_BATCH_MAX_CAPACITY)
+    {
+        u32 WindowCount = glm::min(Count - First, (u32)RENDER_BATCH_MAX_CAPACITY);
+        render_batch* RenderBatch = ReserveBatch(R_POINTS, Key, WindowCount, 0);
+
+        bulk_point_job Job = {};
+        Job.Buffer = &RenderBatch->Buffer;
+        Job.FirstVertex = RenderBatch->Buffer.VertexCount;
+        Job.X = X + First * Stride;
+        Job.Y = Y + First * Stride;
+        Job.PositionStride = Stride;
+        Job.PositionScale = Scale;
+        Job.Colors = Colors + First;
+        Job.OriginX = (f32)Key.OriginX;
+        Job.OriginY = (f32)Key.OriginY;
+
+        ParallelFor(&JobSystem, WindowCount, FillPointsJob, &Job);
+        RenderBatch->Buffer.VertexCount += WindowCount;
+    }
+}
+
+global void DrawPoints(const vec2* Positions, const color* Colors, u32 Count)
+{
+    DrawPointsStrided(&Positions[0].x, &Positions[0].y, 2, 1.0f, Colors, Count);
+}
+
+// Float colors are packed once up front instead of per vertex. Pass
+// Premultiply for points drawn with BLEND_PREMULTIPLIED.
+global void DrawPoints(const vec2* Positions, const vec4* Colors, u32 Count, bool Premultiply = false)
+{
+    color* Packed = GetColorScratch(Count);
+    PackColors(Colors, Packed, Count, Premultiply);
+    DrawPoints(Positions, Packed, Count);
+}
+
+// Structure-of-arrays variant; positions are multiplied by Scale.
+global void DrawPointArrays(const f32* X, const f32* Y, const color* Colors, u32 Count, f32 Scale)
+{
+    DrawPointsStrided(X, Y, 1, Scale, Colors, Count);
+}
+
+// One textured quad before clipping, in world coordinates.
+struct sprite_quad
+{
+    f32 X0, Y0, X1, Y1;
+    f32 U0, V0, U1, V1;
+    color Color;
+};
+
+// The source type supplies a static Read(const source*, u32, sprite_quad*)
+// that describes sprite Index; it is inlined into the fill loop.
+template <typename source>
+struct sprite_fill_job
+{
+    vertex_buffer* Buffer;
+    u32 FirstVertex;
+    u32 FirstIndex;
+    u32 FirstSprite;
+    const source* Source;
+    const rect* Clip;
+    f32 OriginX;
+    f32 OriginY;
+};
+
+template <typename source>
+internal void FillSpritesJob(void* Data, u32 Start, u32 End)
+{
+    typedef batch_format<R_TEXTURES>::type format;
+
+    sprite_fill_job<source>* Job = (sprite_fill_job<source>*)Data;
+
+    for (u32 i = Start; i < End; i++)
+    {
+        sprite_quad Quad;
+        source::Read(Job->Source, Job->FirstSprite + i, &Quad);
+        u32 Vertex = Job->FirstVertex + i * 4;
+
+        // Sprites outside the clip rect collapse to a point
+        if (Job->Clip) ClipQuad(*Job->Clip, &Quad.X0, &Quad.Y0, &Quad.X1, &Quad.Y1, &Quad.U0, &Quad.V0, &Quad.U1, &Quad.V1);
+
+        f32 X0 = Quad.X0 - Job->OriginX;
+        f32 Y0 = Quad.Y0 - Job->OriginY;
+        f32 X1 = Quad.X1 - Job->OriginX;
+        f32 Y1 = Quad.Y1 - Job->OriginY;
+
+        vertex_input Corners[] = {
+            { vec2(X0, Y0), vec2(Quad.U0, Quad.V0), Quad.Color },
+            { vec2(X0, Y1), vec2(Quad.U0, Quad.V1), Quad.Color },
+            { vec2(X1, Y1), vec2(Quad.U1, Quad.V1), Quad.Color },
+            { vec2(X1, Y0), vec2(Quad.U1, Quad.V0), Quad.Color }
+        };
+
+        u8* Vertices = Job->Buffer->Vertices + Vertex * format::Stride;
+        for (s32 Corner = 0; Corner < 4; Corner++)
+        {
+            format::Write(Vertices + Corner * format::Stride, Corners[Corner]);
+        }
+
+        u32* Indices = Job->Buffer->Indices + Job->FirstIndex + i * 6;
+        Indices[0] = Vertex + 0;
+        Indices[1] = Vertex + 1;
+        Indices[2] = Vertex + 2;
+        Indices[3] = Vertex + 0;
+        Indices[4] = Vertex + 2;
+        Indices[5] = Vertex + 3;
+    }
+}
+
+// Writes Count sprites from Source straight into the textured batch, one
+// batch-sized window at a time, filling each window on the job system.
+template <typename source>
+internal void DrawSprites(u32 Texture, const source* Source, u32 Count)
+{
+    u32 QuadsPerWindow = RENDER_BATCH_MAX_CAPACITY / 4;
+    batch_key Key = MakeBatchKey(Texture);
+
+    for (u32 First = 0; First < Count; First += QuadsPerWindow)
+    {
+        u32 WindowCount = glm::min(Count - First, QuadsPerWindow);
+        render_batch* RenderBatch = ReserveBatch(R_TEXTURES, Key, WindowCount * 4, WindowCount * 6);
+
+        sprite_fill_job<source> Job = {};
+        Job.Buffer = &RenderBatch->Buffer;
+        Job.FirstVertex = RenderBatch->Buffer.VertexCount;
+        Job.FirstIndex = RenderBatch->Buffer.ElementCount;
+        Job.FirstSprite = First;
+        Job.Source = Source;
+        Job.Clip = CurrentClip();
+        Job.OriginX = (f32)Key.OriginX;
+        Job.OriginY = (f32)Key.OriginY;
+
+        // Quads are heavier than points, so hand out smaller chunks
+        ParallelFor(&JobSystem, WindowCount, FillSpritesJob<source>, &Job, JobSystem.ChunkSize / 4);
+        RenderBatch->Buffer.VertexCount += WindowCount * 4;
+        RenderBatch->Buffer.ElementCount += WindowCount * 6;
+    }
+}
+
+struct texture_rect_source
+{
+    f32 InvWidth;
+    f32 InvHeight;
+    const rect* SrcRects;
+    const rect* DstRects;
+    const color* Colors;
+
+    static void Read(const texture_rect_source* Source, u32 Index, sprite_quad* Quad)
+    {
+        const rect& SrcRect = Source->SrcRects[Index];
+        const rect& DstRect = Source->DstRects[Index];
+
+        Quad->U0 = SrcRect.X * Source->InvWidth;
+        Quad->V0 = SrcRect.Y * Source->InvHeight;
+        Quad->U1 = (SrcRect.X + SrcRect.Width) * Source->InvWidth;
+        Quad->V1 = (SrcRect.Y + SrcRect.Height) * Source->InvHeight;
+
+        Quad->X0 = (f32)DstRect.X;
+        Quad->Y0 = (f32)DstRect.Y;
+        Quad->X1 = Quad->X0 + DstRect.Width;
+        Quad->Y1 = Quad->Y0 + DstRect.Height;
+        Quad->Color = Source->Colors[Index];
+    }
+};
+
+global void DrawTextures(texture* Texture, const rect* SrcRects, const rect* DstRects, const color* Colors, u32 Count)
+{
+    texture_rect_source Source = {};
+    Source.InvWidth = 1.0f / Texture->Width;
+    Source.InvHeight = 1.0f / Texture->Height;
+    Source.SrcRects = SrcRects;
+    Source.DstRects = DstRects;
+    Source.Colors = Colors;
+
+    DrawSprites(Texture->Handle, &Source, Count);
+}
+
+global void DrawTextures(texture* Texture, const rect* SrcRects, const rect* DstRects, const vec4* Colors, u32 Count, bool Premultiply = false)
+{
+    color* Packed = GetColorScratch(Count);
+    PackColors(Colors, Packed, Count, Premultiply);
+    DrawTextures(Texture, SrcRects, DstRects, Packed, Count);
+}
+
+/*
+================================
+Vertex Sources
+================================
+*/
+
+global vertex_source MakeVertexSource(const f32* Data, u32 Stride = 0)
+{
+    vertex_source Source = { Data, Stride, 1, GL_FLOAT, false };
+    return Source;
+}
+
+global vertex_source MakeVertexSource(const color* Colors, u32 Stride = 0)
+{
+    vertex_source Source = { Colors, Stride, 4, GL_UNSIGNED_BYTE, true };
+    return Source;
+}
+
+internal u32 SourceComponentSize(GLenum Type)
+{
+    switch (Type)
+    {
+        case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: return 2;
+        case GL_UNSIGNED_SHORT: return 2;
+    }
+    return 4;
+}
+
+internal u32 SourceStride(const vertex_source& Source)
+{
+    return Source.Stride ? Source.Stride : SourceComponentSize(Source.Type) * Source.Components;
+}
+
+// Only used when the points have to be copied into a render context.
+internal f32 ReadSourceComponent(const vertex_source& Source, u32 Index, s32 Component)
+{
+    if (Component >= Source.Components) return Component == 3 ? 1.0f : 0.0f;
+
+    const u8* Element = (const u8*)Source.Data + (u64)Index * SourceStride(Source);
+
+    switch (Source.Type)
+    {
+        case GL_UNSIGNED_BYTE:
+        {
+            u8 Value = Element[Component];
+            return Source.Normalized ? Value / 255.0f : Value;
+        }
+        case GL_SHORT:
+        {
+            s16 Value;
+            memcpy(&Value, Element + Component * 2, 2);
+            return Source.Normalized ? glm::max(Value / 32767.0f, -1.0f) : Value;
+        }
+        case GL_UNSIGNED_SHORT:
+        {
+            u16 Value;
+            memcpy(&Value, Element + Component * 2, 2);
+            return Source.Normalized ? Value / 65535.0f : Value;
+        }
+    }
+
+    f32 Value;
+    memcpy(&Value, Element + Component * 4, 4);
+    return Value;
+}
+
+struct source_point_job
+{
+    vertex_buffer* Buffer;
+    u32 FirstVertex;
+    u32 FirstPoint;
+    const vertex_source* Sources;
+    f32 Scale;
+    f32 OriginX;
+    f32 OriginY;
+};
+
+internal void FillSourcePointsJob(void* Data, u32 Start, u32 End)
+{
+    typedef batch_format<R_POINTS>::type format;
+
+    source_point_job* Job = (source_point_job*)Data;
+    const vertex_source* Sources = Job->Sources;
+    u8* Vertex = Job->Buffer->Vertices + (Job->FirstVertex + Start) * format::Stride;
+
+    vertex_input Input = {};
+
+    for (u32 i = Job->FirstPoint + Start; i < Job->FirstPoint + End; i++)
+    {
+        Input.Position.x = ReadSourceComponent(Sources[POINT_SOURCE_X], i, 0) * Job->Scale - Job->OriginX;
+        Input.Position.y = ReadSourceComponent(Sources[POINT_SOURCE_Y], i, 0) * Job->Scale - Job->OriginY;
+        Input.Color.R = (u8)(ReadSourceComponent(Sources[POINT_SOURCE_COLOR], i, 0) * 255.0f + 0.5f);
+        Input.Color.G = (u8)(ReadSourceComponent(Sources[POINT_SOURCE_COLOR], i, 1) * 255.0f + 0.5f);
+        Input.Color.B = (u8)(ReadSourceComponent(Sources[POINT_SOURCE_COLOR], i, 2) * 255.0f + 0.5f);
+        Input.Color.A = (u8)(ReadSourceComponent(Sources[POINT_SOURCE_COLOR], i, 3) * 255.0f + 0.5f);
+        format::Write(Vertex, Input);
+        Vertex += format::Stride;
+    }
+}
+
+// Recording threads cannot keep pointers to caller memory until the frame
+// is replayed, so the points are copied into the context like DrawPoints.
+internal void RecordPointSources(const vertex_source* Sources, u32 Count, f32 Scale)
+{
+    batch_key Key = MakeBatchKey(0);
+    if (!ScissorBatchKey(&Key)) return;
+
+    for (u32 First = 0; First < Count; First += RENDER_BATCH_MAX_CAPACITY)
+    {
+        u32 WindowCount = glm::min(Count - First, (u32)RENDER_BATCH_MAX_CAPACITY);
+        render_batch* RenderBatch = ReserveBatch(R_POINTS, Key, WindowCount, 0);
+
+        source_point_job Job = {};
+        Job.Buffer = &RenderBatch->Buffer;
+        Job.FirstVertex = RenderBatch->Buffer.VertexCount;
+        Job.FirstPoint = First;
+        Job.Sources = Sources;
+        Job.Scale = Scale;
+        Job.OriginX = (f32)Key.OriginX;
+        Job.OriginY = (f32)Key.OriginY;
+
+        ParallelFor(&JobSystem, WindowCount, FillSourcePointsJob, &Job);
+        RenderBatch->Buffer.VertexCount += WindowCount;
+    }
+}
+
+// Draws Count points straight from caller memory. Each array is uploaded
+// with a single transfer and GL reads it with the caller's stride and type,
+// so nothing is repacked on the CPU; X and Y may point into the same
+// interleaved array, which is then uploaded once. Positions are multiplied
+// by Scale.
+//
+// Like DrawGpuParticles this draws immediately, on the thread that owns
+// the GL context. Inside a render context, with a render thread or with
+// depth passes the points are copied into the batch instead.
+global void DrawPointSources(const vertex_source& X, const vertex_source& Y, const vertex_source& Colors, u32 Count, f32 Scale)
+{
+    if (!Count) return;
+
+    const vertex_source Sources[POINT_SOURCE_COUNT] = { X, Y, Colors };
+
+    if (ActiveContext || RenderState.DepthPasses)
+    {
+        RecordPointSources(Sources, Count, Scale);
+        return;
+    }
+
+    batch_key Key = {};
+    if (!ScissorBatchKey(&Key)) return;
+
+    point_source_state* State = &RenderState.PointSources;
+
+    if (!State->Vao)
+    {
+        glGenVertexArrays(1, &State->Vao);
+        glGenBuffers(POINT_SOURCE_COUNT, State->Vbos);
+    }
+
+    // Keep the order with everything drawn before
+    FlushRenderBatches();
+
+    BindBlendMode(RenderState.DrawState.Blend);
+    BindScissor(Key.Scissor);
+    BindProgram(State->Program);
+    glUniformMatrix4fv(State->ProjectionLocation, 1, 0, &RenderState.Projection[0][0]);
+    glUniformMatrix4fv(State->ModelViewLocation, 1, 0, &RenderState.ModelView[0][0]);
+    glUniform1f(State->ScaleLocation, Scale);
+    glUniform1f(State->DepthLocation, RenderState.DrawState.Depth);
+
+    BindVertexArray(State->Vao);
+
+    for (s32 i = 0; i < POINT_SOURCE_COUNT; i++)
+    {
+        const vertex_source& Source = Sources[i];
+        u32 Stride = SourceStride(Source);
+
+        // A source inside the first element of an earlier one with the
+        // same stride is an interleaved field of the same array
+        u32 Vbo = State->Vbos[i];
+        u64 Offset = 0;
+        bool Upload = true;
+
+        for (s32 Earlier = 0; Earlier < i; Earlier++)
+        {
+            const u8* Base = (const u8*)Sources[Earlier].Data;
+            const u8* Field = (const u8*)Source.Data;
+
+            if (SourceStride(Sources[Earlier]) == Stride && Field >= Base && Field < Base + Stride)
+            {
+                Vbo = State->Vbos[Earlier];
+                Offset = Field - Base;
+                Upload = false;
+                break;
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, Vbo);
+
+        if (Upload)
+        {
+            u64 Size = (u64)(Count - 1) * Stride + SourceComponentSize(Source.Type) * Source.Components;
+            glBufferData(GL_ARRAY_BUFFER, Size, Source.Data, GL_STREAM_DRAW);
+        }
+
+        glEnableVertexAttribArray(State->Locations[i]);
+        glVertexAttribPointer(State->Locations[i], Source.Components, Source.Type, Source.Normalized, Stride, (const void*)(uintptr_t)Offset);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDrawArrays(GL_POINTS, 0, Count);
+
+    RenderState.Stats.DrawCalls++;
+    RenderState.Stats.Vertices += Count;
+}
+
+/*
+================================
+Render Targets
+================================
+*/
+
+global render_target* CreateRenderTarget(s32 Width, s32 Height)
+{
+    render_target* Result = (render_target*)calloc(1, sizeof(render_target));
+    Result->Texture.Width = Width;
+    Result->Texture.Height = Height;
+
+    glGenTextures(1, &Result->Texture.Handle);
+    glBindTexture(GL_TEXTURE_2D, Result->Texture.Handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &Result->DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, Result->DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &Result->Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, Result->Framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Result->Texture.Handle, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, Result->DepthBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Render target %dx%d is incomplete\n", Width, Height);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    InvalidateGLStateCache();
+    return Result;
+}
+
+global void FreeRenderTarget(render_target* Target)
+{
+    glDeleteFramebuffers(1, &Target->Framebuffer);
+    glDeleteRenderbuffers(1, &Target->DepthBuffer);
+    glDeleteTextures(1, &Target->Texture.Handle);
+    InvalidateGLStateCache();
+    free(Target);
+}
+
+// Draws everything recorded so far into the bound framebuffer.
+internal void FlushPendingDraws()
+{
+    FlushRenderBatches();
+    DrawDepthPasses();
+    BindScissor(rect{});
+}
+
+// Redirects the following draws into Target until EndRenderTarget. The
+// target shows the drawing space from (X, Y) on, so code that draws in
+// screen coordinates can be pointed at it unchanged. Targets switch
+// framebuffers right away, so this only works on the thread that owns the
+// GL context, without a render thread or a bound render context, and
+// targets do not nest; otherwise it returns false.
+global bool BeginRenderTarget(render_target* Target, s32 X = 0, s32 Y = 0)
+{
+    if (RenderThread.Running || ActiveContext || RenderState.Target) return false;
+
+    FlushPendingDraws();
+
+    RenderState.ScreenProjection = RenderState.Projection;
+    RenderState.ScreenModelView = RenderState.ModelView;
+    RenderState.Target = Target;
+    RenderState.TargetX = X;
+    RenderState.TargetY = Y;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, Target->Framebuffer);
+    glViewport(0, 0, Target->Texture.Width, Target->Texture.Height);
+
+    // Bottom up, so the first row written is the texture's V = 0
+    mat4 Projection = glm::ortho((f32)X, (f32)(X + Target->Texture.Width),
+        (f32)Y, (f32)(Y + Target->Texture.Height), -1.0f, 1.0f);
+    SetMatrices(Projection, glm::mat4(1.0f));
+    return true;
+}
+
+global void EndRenderTarget()
+{
+    if (!RenderState.Target) return;
+
+    FlushPendingDraws();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, RenderState.FramebufferWidth, RenderState.FramebufferHeight);
+    RenderState.Target = 0;
+    SetMatrices(RenderState.ScreenProjection, RenderState.ScreenModelView);
+}
+
+/*
+================================
+Layer Cache
+================================
+*/
+
+global cached_layer* CreateCachedLayer(const rect& Bounds)
+{
+    cached_layer* Result = (cached_layer*)calloc(1, sizeof(cached_layer));
+    Result->Target = CreateRenderTarget(Bounds.Width, Bounds.Height);
+    Result->Bounds = Bounds;
+    Result->Dirty = true;
+    return Result;
+}
+
+global void FreeCachedLayer(cached_layer* Layer)
+{
+    FreeRenderTarget(Layer->Target);
+    free(Layer);
+}
+
+global void MarkLayerDirty(cached_layer* Layer)
+{
+    Layer->Dirty = true;
+}
+
+// Returns true when the layer's contents have to be drawn again: draw them
+// in screen coordinates, then call EndCachedLayer. Returns false while the
+// cached image is current, or when the layer can't be redrawn from this
+// thread (see BeginRenderTarget), in which case it stays dirty.
+global bool BeginCachedLayer(cached_layer* Layer)
+{
+    if (!Layer->Dirty) return false;
+    if (!BeginRenderTarget(Layer->Target, Layer->Bounds.X, Layer->Bounds.Y)) return false;
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+global void EndCachedLayer(cached_layer* Layer)
+{
+    EndRenderTarget();
+    Layer->Dirty = false;
+}
 
-    RenderBatch->Texture = Texture->Handle;
-}
\ No newline at end of file
+// Composites the cached image over its bounds as one textured quad. It is
+// premultiplied, so it is drawn with BLEND_PREMULTIPLIED whatever the
+// current blend mode is.
+global void DrawCachedLayer(cached_layer* Layer)
+{
+    draw_state* State = CurrentDrawState();
+    u32 Blend = State->Blend;
+    State->Blend = BLEND_PREMULTIPLIED;
+
+    texture* Texture = &Layer->Target->Texture;
+    rect SrcRect = { 0, 0, Texture->Width, Texture->Height };
+    DrawTexture(Texture, SrcRect, Layer->Bounds, COLOR_WHITE);
+
+    State->Blend = Blend;
+}
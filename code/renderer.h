@@ -1,6 +1,34 @@
 #pragma once
 
-#define RENDER_BATCH_MAX_CAPACITY 2048
+#define RENDER_BATCH_MAX_CAPACITY 65536
+#define RENDER_BATCH_MAX_INDICES (RENDER_BATCH_MAX_CAPACITY / 4 * 6)
+
+// Index that ends one line strip and starts the next within a draw call.
+#define RENDER_PRIMITIVE_RESTART 0xFFFFFFFFu
+
+#define RENDER_CONTEXT_MAX_COUNT 64
+#define RENDER_CONTEXT_INITIAL_CAPACITY 4096
+
+// Build with RENDER_COMPACT_VERTICES=1 to store positions as s16 relative
+// to the batch origin and texture coordinates as unorm16, which makes a
+// textured vertex 12 bytes. Positions then snap to whole pixels and
+// texture coordinates are clamped to 0..1.
+#ifndef RENDER_COMPACT_VERTICES
+#define RENDER_COMPACT_VERTICES 0
+#endif
+
+#define RENDER_MAX_DYNAMIC_TEXTURES 8
+#define CURVE_MAX_SEGMENTS 1024
+#define CURVE_DEFAULT_TOLERANCE 0.25f
+#define RENDER_MAX_FRAMES_IN_FLIGHT 4
+#define RENDER_PACKET_QUEUE_SIZE 8
+
+// Layers run from -RENDER_MAX_LAYER to RENDER_MAX_LAYER and map to evenly
+// spaced depths inside the clip volume; higher layers are drawn on top.
+#define RENDER_MAX_LAYER 1023
+
+// Clip rects nested deeper than this are ignored along with their pops.
+#define RENDER_MAX_CLIP_DEPTH 16
 
 #define COLOR_WHITE color{ 255, 255, 255, 255 }
 #define COLOR_BLACK color{   0,   0,   0, 255 }
@@ -21,23 +49,39 @@ struct rect
     s32 Height;
 };
 
+// Border widths of a nine-slice source rect, in texels. The corners keep
+// their size and the edges and center stretch.
+struct borders
+{
+    s32 Left;
+    s32 Top;
+    s32 Right;
+    s32 Bottom;
+};
+
 enum attribute
 {
     ATTRIB_POSITION,
     ATTRIB_TEXCOORD,
     ATTRIB_COLOR,
+    ATTRIB_ENDPOINTS,
+    ATTRIB_SHAPE,
+    ATTRIB_BOUNDS,
     ATTRIB_COUNT
 };
 
+// Interleaved vertices laid out by one of the vertex_format types; Stride
+// is that format's size in bytes.
 struct vertex_buffer
 {
     u32 Vao;
-    u32 Vbos[4];
-    f32 *Positions;
-    f32 *TexCoords;
-    f32 *Colors;
+    u32 VertexVbo;
+    u32 IndexVbo;
+    u8 *Vertices;
     u32 *Indices;
+    u32 Stride;
     u64 Capacity;
+    u64 IndexCapacity;
     u32 VertexCount;
     u32 ElementCount;
     s32 Usage;
@@ -50,10 +94,108 @@ struct texture
     s32 Height;
 };
 
+// Framebuffer with a color texture and a depth buffer. Blending onto the
+// transparent clear premultiplies colors, so the texture holds
+// premultiplied alpha. Rows are stored top first, so V = 0 is the top of
+// what was drawn, as with any loaded texture.
+struct render_target
+{
+    u32 Framebuffer;
+    u32 DepthBuffer;
+    texture Texture;
+};
+
+// A rect of the screen whose contents are drawn into a render target only
+// after they are marked dirty, and otherwise composited from it. New layers
+// start dirty.
+struct cached_layer
+{
+    render_target* Target;
+    rect Bounds;
+    bool Dirty;
+};
+
+// Single-channel texture with a CPU copy that any thread may write. Rows
+// touched since the last upload are sent to GL right before a textured
+// batch is drawn. It samples as (1, 1, 1, value), so it tints like a sprite.
+struct dynamic_texture
+{
+    texture Texture;
+    u8* Pixels;
+    s32 DirtyMinY;
+    s32 DirtyMaxY;
+    std::mutex Lock;
+};
+
+// Fragment shader features. Each combination is compiled into its own
+// program at init, and every batch draws with the smallest one it needs.
+enum shader_feature
+{
+    SHADER_TEXTURED      = 1 << 0,
+    SHADER_ALPHA_TEST    = 1 << 1,
+    SHADER_PREMULTIPLIED = 1 << 2,
+    SHADER_SDF           = 1 << 3,
+    SHADER_VARIANT_COUNT = 1 << 4
+};
+
+// How a batch's fragments combine with the framebuffer. Colors are straight
+// alpha unless the mode says otherwise.
+enum blend_mode
+{
+    BLEND_ALPHA,          // Source over, the default
+    BLEND_PREMULTIPLIED,  // Source over for colors already multiplied by alpha
+    BLEND_ADDITIVE,       // Adds the color scaled by alpha, for glows and sparks
+    BLEND_MULTIPLY,       // Darkens by the color, fading to no change at alpha 0
+    BLEND_OPAQUE,         // Blending off; alpha is written as is
+    BLEND_MODE_COUNT
+};
+
+struct shader_variant
+{
+    u32 Program;
+    s32 ProjectionLocation;
+    s32 ModelViewLocation;
+    s32 OriginLocation;
+    u32 MatrixVersion;
+};
+
+// Everything besides the primitive mode that forces a new draw call.
+// Vertices only store positions relative to the origin; the origin and the
+// depth are uniforms of the draw. Scissor is only set for primitives that
+// cross the edge of the clip rect and could not be clipped on the CPU; a
+// zero width means no scissor.
+struct batch_key
+{
+    u32 Texture;
+    u32 Features;
+    s32 OriginX;
+    s32 OriginY;
+    f32 Depth;
+    u32 Blend;
+    rect Scissor;
+};
+
+// Per-thread drawing state that ends up in the batch key. The current clip
+// rect is ClipStack[min(ClipDepth, RENDER_MAX_CLIP_DEPTH) - 1].
+struct draw_state
+{
+    u32 Features;
+    s32 OriginX;
+    s32 OriginY;
+    u32 Blend;
+    f32 Depth;
+    rect ClipStack[RENDER_MAX_CLIP_DEPTH];
+    u32 ClipDepth;
+};
+
+// Instanced batches draw one quad per record in Buffer, with the variant
+// table of their own shaders.
 struct render_batch
 {
     s32 Mode;
-    u32 Texture;
+    bool Instanced;
+    shader_variant* Variants;
+    batch_key Key;
     vertex_buffer Buffer;
 };
 
@@ -61,18 +203,238 @@ enum render_mode
 {
     R_POINTS,
     R_LINES,
+    R_LINE_STRIPS,
     R_TRIANGLES,
     R_TEXTURES,
+    R_THICK_LINES,
+    R_SHAPES,
     R_MODE_COUNT
 };
 
+enum line_flags
+{
+    LINE_ROUND        = 1 << 0,
+    LINE_START_JOINED = 1 << 1,
+    LINE_END_JOINED   = 1 << 2
+};
+
+enum line_join
+{
+    LINE_JOIN_MITER,
+    LINE_JOIN_ROUND
+};
+
+// A run of primitives inside a render_context that shares one mode and
+// batch key. Vertex and index ranges are relative to the context's batch.
+struct render_command
+{
+    s32 Mode;
+    batch_key Key;
+    u32 FirstVertex;
+    u32 VertexCount;
+    u32 FirstIndex;
+    u32 IndexCount;
+};
+
+// CPU-only recording target. A thread binds one with BeginRenderContext and
+// every Draw* call on that thread lands here instead of the GL batches.
+// EndFrame merges all contexts ordered by (SortKey, Index).
+struct render_context
+{
+    s32 SortKey;
+    u32 Index;
+    draw_state State;
+    render_batch Batches[R_MODE_COUNT];
+    render_command* Commands;
+    u32 CommandCount;
+    u32 CommandCapacity;
+    s32 OpenCommands[R_MODE_COUNT];
+    u32 OpenBlend;
+    f32 OpenDepth;
+};
+
+// Everything the render thread needs to draw one frame.
+struct frame_packet
+{
+    render_context Context;
+    glm::mat4 Projection;
+    glm::mat4 ModelView;
+    color ClearColor;
+    bool Clear;
+};
+
+// Lock-free single-producer single-consumer ring of packet pointers. The
+// lock only guards WakeUp, so a consumer finding the ring empty can sleep.
+struct packet_queue
+{
+    frame_packet* Slots[RENDER_PACKET_QUEUE_SIZE];
+    std::atomic<u32> Head;
+    std::atomic<u32> Tail;
+    std::mutex SleepLock;
+    std::condition_variable WakeUp;
+};
+
+typedef void render_thread_callback(void* User);
+
+// Packets circulate between two queues: the game thread takes one from
+// Free, records into it and pushes it to Submitted; the render thread
+// replays it and hands it back through Free. FramesInFlight packets exist,
+// which bounds how far the game thread can run ahead.
+struct render_thread
+{
+    frame_packet Packets[RENDER_MAX_FRAMES_IN_FLIGHT];
+    u32 FramesInFlight;
+    packet_queue Submitted;
+    packet_queue Free;
+    frame_packet* Recording;
+    render_thread_callback* MakeCurrent;
+    render_thread_callback* Present;
+    void* User;
+    std::thread Thread;
+    std::atomic<bool> Running;
+};
+
+// GL_ARB_get_program_binary is core in 4.1 only, so the entry points are
+// loaded by hand and the cache stays off when the driver lacks them.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (GLAD_API_PTR *PFNGLGETPROGRAMBINARYPROC)(GLuint Program, GLsizei BufSize, GLsizei* Length, GLenum* BinaryFormat, void* Binary);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMBINARYPROC)(GLuint Program, GLenum BinaryFormat, const void* Binary, GLsizei Length);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMPARAMETERIPROC)(GLuint Program, GLenum PName, GLint Value);
+
+#define PROGRAM_CACHE_MAGIC 0x31424750 // "PGB1"
+
+// Programs are stored as "shader_<hash>.bin" in the working directory, where
+// font paths are resolved too. The hash covers both sources and the GL
+// vendor, renderer and version strings, so a driver update or a shader edit
+// simply misses the cache.
+struct program_cache
+{
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinary;
+    PFNGLPROGRAMBINARYPROC ProgramBinary;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteri;
+    bool Enabled;
+    u64 DriverHash;
+    u32 Hits;
+    u32 Misses;
+    f64 Seconds;
+};
+
+struct program_binary_header
+{
+    u32 Magic;
+    u32 Format;
+    u32 Length;
+    u32 Padding;
+    u64 Hash;
+};
+
+// Caller-owned array read directly as a vertex attribute. Stride is the
+// distance between elements in bytes, or 0 when they are tightly packed.
+struct vertex_source
+{
+    const void* Data;
+    u32 Stride;
+    s32 Components;
+    GLenum Type;
+    bool Normalized;
+};
+
+enum point_source
+{
+    POINT_SOURCE_X,
+    POINT_SOURCE_Y,
+    POINT_SOURCE_COLOR,
+    POINT_SOURCE_COUNT
+};
+
+// GL side of DrawPointSources. Attribute pointers are set up again for
+// every draw, since they follow the caller's stride and type.
+struct point_source_state
+{
+    u32 Program;
+    s32 ProjectionLocation;
+    s32 ModelViewLocation;
+    s32 ScaleLocation;
+    s32 DepthLocation;
+    s32 Locations[POINT_SOURCE_COUNT];
+    u32 Vao;
+    u32 Vbos[POINT_SOURCE_COUNT];
+};
+
+// Last GL state set by the renderer, so redundant binds can be skipped.
+struct gl_state_cache
+{
+    u32 Program;
+    u32 Texture;
+    u32 Vao;
+    u32 Blend;
+    u32 BlendFactors;
+    rect Scissor;
+};
+
+struct render_stats
+{
+    u32 Frames;
+    u32 DrawCalls;
+    u32 Vertices;
+    u32 ProgramBinds;
+    u32 TextureBinds;
+    u32 BlendSwitches;
+    u32 ScissorChanges;
+    u64 SamplesPassed;
+};
+
+// With depth passes on, GL batches are not filled while drawing. Commands
+// are recorded per pass and sorted by depth at the end of the frame: opaque
+// ones front to back with depth writes, so hidden fragments fail the depth
+// test early, then translucent ones back to front on top of them.
+enum render_pass
+{
+    PASS_OPAQUE,
+    PASS_TRANSLUCENT,
+    PASS_COUNT
+};
+
 struct render_state
 {
     s32 FramebufferWidth;
     s32 FramebufferHeight;
-    GLuint Program;
+    program_cache ProgramCache;
+    shader_variant Variants[SHADER_VARIANT_COUNT];
+    shader_variant LineVariants[SHADER_VARIANT_COUNT];
+    shader_variant ShapeVariants[SHADER_VARIANT_COUNT];
+    point_source_state PointSources;
+    gl_state_cache GLState;
     glm::mat4 Projection;
     glm::mat4 ModelView;
-    f32 CurrentDepth;
+    u32 MatrixVersion;
+    draw_state DrawState;
+    render_stats Stats;
+    render_stats ReportedStats;
+    std::mutex StatsLock;
     render_batch RenderBatches[R_MODE_COUNT];
+    u32 PendingBlend;
+    f32 PendingDepth;
+    bool DepthPasses;
+    render_context Passes[PASS_COUNT];
+    u32* PassOrder;
+    u32 PassOrderCapacity;
+    u32 SampleQueries[RENDER_MAX_FRAMES_IN_FLIGHT];
+    u32 QueriesBegun;
+    u32 QueriesRead;
+    render_context* Contexts[RENDER_CONTEXT_MAX_COUNT];
+    u32 ContextCount;
+    dynamic_texture* DynamicTextures[RENDER_MAX_DYNAMIC_TEXTURES];
+    u32 DynamicTextureCount;
+    render_target* Target;
+    s32 TargetX;
+    s32 TargetY;
+    glm::mat4 ScreenProjection;
+    glm::mat4 ScreenModelView;
+    u32 FrameIndex;
+    f32 PixelsPerUnit;
+    f32 CurveTolerance;
 };
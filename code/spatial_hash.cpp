@@ -0,0 +1,230 @@
+/*
+================================
+Spatial Hash
+================================
+*/
+
+global void InitSpatialHash(spatial_hash* Hash, f32 WorldWidth, f32 WorldHeight, f32 CellSize, u32 Capacity)
+{
+    *Hash = {};
+    Hash->CellSize = CellSize;
+    Hash->InvCellSize = 1.0f / CellSize;
+    Hash->Columns = glm::max((s32)ceilf(WorldWidth / CellSize), 1);
+    Hash->Rows = glm::max((s32)ceilf(WorldHeight / CellSize), 1);
+    Hash->CellCount = Hash->Columns * Hash->Rows;
+    Hash->Capacity = Capacity;
+    Hash->CellStart = (u32*)malloc(sizeof(u32) * (Hash->CellCount + 1));
+    Hash->ChunkCounts = (u32*)malloc(sizeof(u32) * Hash->CellCount * SPATIAL_HASH_MAX_CHUNKS);
+    Hash->PointCells = (u32*)malloc(sizeof(u32) * Capacity);
+    Hash->SortedIndex = (u32*)malloc(sizeof(u32) * Capacity);
+    Hash->SortedX = (f32*)malloc(sizeof(f32) * Capacity);
+    Hash->SortedY = (f32*)malloc(sizeof(f32) * Capacity);
+}
+
+global void FreeSpatialHash(spatial_hash* Hash)
+{
+    free(Hash->CellStart);
+    free(Hash->ChunkCounts);
+    free(Hash->PointCells);
+    free(Hash->SortedIndex);
+    free(Hash->SortedX);
+    free(Hash->SortedY);
+    *Hash = {};
+}
+
+// Reallocates the per-point arrays; the grid itself is unchanged.
+global void GrowSpatialHash(spatial_hash* Hash, u32 Capacity)
+{
+    if (Capacity <= Hash->Capacity) return;
+
+    Hash->Capacity = Capacity;
+    Hash->PointCells = (u32*)realloc(Hash->PointCells, sizeof(u32) * Capacity);
+    Hash->SortedIndex = (u32*)realloc(Hash->SortedIndex, sizeof(u32) * Capacity);
+    Hash->SortedX = (f32*)realloc(Hash->SortedX, sizeof(f32) * Capacity);
+    Hash->SortedY = (f32*)realloc(Hash->SortedY, sizeof(f32) * Capacity);
+}
+
+internal s32 SpatialHashColumn(spatial_hash* Hash, f32 X)
+{
+    return glm::clamp((s32)(X * Hash->InvCellSize), 0, Hash->Columns - 1);
+}
+
+internal s32 SpatialHashRow(spatial_hash* Hash, f32 Y)
+{
+    return glm::clamp((s32)(Y * Hash->InvCellSize), 0, Hash->Rows - 1);
+}
+
+struct spatial_hash_job
+{
+    spatial_hash* Hash;
+    const f32* X;
+    const f32* Y;
+};
+
+// Pass 1: each chunk bins its points and counts them per cell.
+internal void CountSpatialHashJob(void* Data, u32 Start, u32 End)
+{
+    spatial_hash_job* Job = (spatial_hash_job*)Data;
+    spatial_hash* Hash = Job->Hash;
+
+    for (u32 Chunk = Start; Chunk < End; Chunk++)
+    {
+        u32* Counts = Hash->ChunkCounts + Chunk * Hash->CellCount;
+        memset(Counts, 0, sizeof(u32) * Hash->CellCount);
+
+        u32 First = Chunk * Hash->ChunkSize;
+        u32 Last = glm::min(First + Hash->ChunkSize, Hash->Count);
+
+        for (u32 i = First; i < Last; i++)
+        {
+            u32 Cell = SpatialHashRow(Hash, Job->Y[i]) * Hash->Columns + SpatialHashColumn(Hash, Job->X[i]);
+            Hash->PointCells[i] = Cell;
+            Counts[Cell]++;
+        }
+    }
+}
+
+// Pass 3: each chunk scatters its points into the slots reserved for it.
+// Chunks keep their points in input order, so the result is deterministic.
+internal void ScatterSpatialHashJob(void* Data, u32 Start, u32 End)
+{
+    spatial_hash_job* Job = (spatial_hash_job*)Data;
+    spatial_hash* Hash = Job->Hash;
+
+    for (u32 Chunk = Start; Chunk < End; Chunk++)
+    {
+        u32* Offsets = Hash->ChunkCounts + Chunk * Hash->CellCount;
+
+        u32 First = Chunk * Hash->ChunkSize;
+        u32 Last = glm::min(First + Hash->ChunkSize, Hash->Count);
+
+        for (u32 i = First; i < Last; i++)
+        {
+            u32 Slot = Offsets[Hash->PointCells[i]]++;
+            Hash->SortedIndex[Slot] = i;
+            Hash->SortedX[Slot] = Job->X[i];
+            Hash->SortedY[Slot] = Job->Y[i];
+        }
+    }
+}
+
+// Returns false without touching the hash when Count exceeds its capacity;
+// grow it with GrowSpatialHash and build again. Jobs may be 0 to build on
+// the calling thread.
+global bool BuildSpatialHash(spatial_hash* Hash, const f32* X, const f32* Y, u32 Count, job_system* Jobs)
+{
+    if (Count > Hash->Capacity) return false;
+
+    Hash->Count = Count;
+    Hash->ChunkSize = glm::max((Hash->Count + SPATIAL_HASH_MAX_CHUNKS - 1) / SPATIAL_HASH_MAX_CHUNKS, (u32)SPATIAL_HASH_MIN_CHUNK_SIZE);
+    Hash->ChunkCount = glm::max((Hash->Count + Hash->ChunkSize - 1) / Hash->ChunkSize, 1u);
+
+    spatial_hash_job Job = { Hash, X, Y };
+
+    if (Jobs) ParallelFor(Jobs, Hash->ChunkCount, CountSpatialHashJob, &Job, 1);
+    else CountSpatialHashJob(&Job, 0, Hash->ChunkCount);
+
+    // Pass 2: exclusive prefix sum over (cell, chunk), turning the chunk
+    // counts into the first slot each chunk writes for that cell
+    u32 Offset = 0;
+    for (u32 Cell = 0; Cell < Hash->CellCount; Cell++)
+    {
+        Hash->CellStart[Cell] = Offset;
+        for (u32 Chunk = 0; Chunk < Hash->ChunkCount; Chunk++)
+        {
+            u32* Counts = Hash->ChunkCounts + Chunk * Hash->CellCount;
+            u32 CellCount = Counts[Cell];
+            Counts[Cell] = Offset;
+            Offset += CellCount;
+        }
+    }
+    Hash->CellStart[Hash->CellCount] = Offset;
+
+    if (Jobs) ParallelFor(Jobs, Hash->ChunkCount, ScatterSpatialHashJob, &Job, 1);
+    else ScatterSpatialHashJob(&Job, 0, Hash->ChunkCount);
+    return true;
+}
+
+/*
+================================
+Particle Separation
+================================
+*/
+
+struct separation_job
+{
+    spatial_hash* Hash;
+    particle_system* System;
+    f32 Radius;
+    f32 Strength;
+};
+
+// Walks the points in grid order and steers each one away from the
+// neighbors inside Radius, weighted by how deep they overlap.
+internal void SeparateParticlesJob(void* Data, u32 Start, u32 End)
+{
+    separation_job* Job = (separation_job*)Data;
+    spatial_hash* Hash = Job->Hash;
+    particle_system* System = Job->System;
+    f32 Radius2 = Job->Radius * Job->Radius;
+    f32 InvRadius = 1.0f / Job->Radius;
+
+    for (u32 Slot = Start; Slot < End; Slot++)
+    {
+        f32 X = Hash->SortedX[Slot];
+        f32 Y = Hash->SortedY[Slot];
+        s32 Column = SpatialHashColumn(Hash, X);
+        s32 Row = SpatialHashRow(Hash, Y);
+
+        f32 PushX = 0.0f;
+        f32 PushY = 0.0f;
+
+        for (s32 NeighborRow = glm::max(Row - 1, 0); NeighborRow <= glm::min(Row + 1, Hash->Rows - 1); NeighborRow++)
+        {
+            u32 RowBase = NeighborRow * Hash->Columns;
+            u32 First = Hash->CellStart[RowBase + glm::max(Column - 1, 0)];
+            u32 Last = Hash->CellStart[RowBase + glm::min(Column + 1, Hash->Columns - 1) + 1];
+
+            // Neighboring cells of a row are contiguous in the sorted arrays
+            for (u32 Other = First; Other < Last; Other++)
+            {
+                f32 AwayX = X - Hash->SortedX[Other];
+                f32 AwayY = Y - Hash->SortedY[Other];
+                f32 Distance2 = AwayX * AwayX + AwayY * AwayY;
+
+                if (Distance2 < Radius2 && Distance2 > 0.0f)
+                {
+                    f32 Distance = sqrtf(Distance2);
+                    f32 Weight = (1.0f - Distance * InvRadius) / Distance;
+                    PushX += AwayX * Weight;
+                    PushY += AwayY * Weight;
+                }
+            }
+        }
+
+        if (PushX == 0.0f && PushY == 0.0f) continue;
+
+        u32 i = Hash->SortedIndex[Slot];
+        f32 DirX = System->DirX[i] + PushX * Job->Strength;
+        f32 DirY = System->DirY[i] + PushY * Job->Strength;
+        f32 Length2 = DirX * DirX + DirY * DirY;
+
+        if (Length2 > 0.0f)
+        {
+            f32 InvLength = 1.0f / sqrtf(Length2);
+            System->DirX[i] = DirX * InvLength;
+            System->DirY[i] = DirY * InvLength;
+        }
+    }
+}
+
+// Hash must have been built from System's current positions with a cell
+// size of at least Radius. Only the directions are changed; UpdateParticles
+// integrates them afterwards.
+global void SeparateParticles(particle_system* System, spatial_hash* Hash, f32 Radius, f32 Strength, job_system* Jobs)
+{
+    separation_job Job = { Hash, System, Radius, Strength };
+
+    if (Jobs) ParallelFor(Jobs, Hash->Count, SeparateParticlesJob, &Job, Jobs->ChunkSize / 4);
+    else SeparateParticlesJob(&Job, 0, Hash->Count);
+}
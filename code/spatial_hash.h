@@ -0,0 +1,27 @@
+#pragma once
+
+#define SPATIAL_HASH_MAX_CHUNKS 64
+#define SPATIAL_HASH_MIN_CHUNK_SIZE 16384
+
+// Uniform grid over the world bounds, rebuilt every frame with a counting
+// sort. After BuildSpatialHash the points of cell C are
+// SortedIndex[CellStart[C] .. CellStart[C + 1]), and SortedX/SortedY hold
+// their positions in the same order so neighbor loops read memory linearly.
+struct spatial_hash
+{
+    f32 CellSize;
+    f32 InvCellSize;
+    s32 Columns;
+    s32 Rows;
+    u32 CellCount;
+    u32 Count;
+    u32 Capacity;
+    u32 ChunkCount;
+    u32 ChunkSize;
+    u32* CellStart;
+    u32* ChunkCounts;
+    u32* PointCells;
+    u32* SortedIndex;
+    f32* SortedX;
+    f32* SortedY;
+};
@@ -0,0 +1,239 @@
+#pragma once
+
+// A vertex format is a list of attribute types. Offsets and the stride are
+// computed at compile time, and the same list generates the VAO setup and
+// the vertex writer, so a new format never needs hand-written layout code.
+
+// Everything a Draw* call knows about a vertex. Each attribute encodes the
+// part it stores and ignores the rest.
+struct vertex_input
+{
+    vec2 Position;
+    vec2 TexCoord;
+    color Color;
+};
+
+/*
+================================
+Attributes
+================================
+*/
+
+struct position_f32x2
+{
+    enum { Location = ATTRIB_POSITION, Components = 2, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 2 };
+
+    static void Encode(u8* Dest, const vertex_input& Input)
+    {
+        memcpy(Dest, &Input.Position[0], Size);
+    }
+};
+
+// Whole pixels relative to the batch origin. Anything further than 32k
+// pixels away is off screen, so clamping it only moves it further off.
+struct position_s16x2
+{
+    enum { Location = ATTRIB_POSITION, Components = 2, Type = GL_SHORT, Normalized = GL_FALSE, Size = sizeof(s16) * 2 };
+
+    static void Encode(u8* Dest, const vertex_input& Input)
+    {
+        s16 Position[] = {
+            (s16)glm::clamp(floorf(Input.Position.x + 0.5f), -32768.0f, 32767.0f),
+            (s16)glm::clamp(floorf(Input.Position.y + 0.5f), -32768.0f, 32767.0f)
+        };
+        memcpy(Dest, Position, Size);
+    }
+};
+
+struct texcoord_f32x2
+{
+    enum { Location = ATTRIB_TEXCOORD, Components = 2, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 2 };
+
+    static void Encode(u8* Dest, const vertex_input& Input)
+    {
+        memcpy(Dest, &Input.TexCoord[0], Size);
+    }
+};
+
+// 1/65535 steps are a quarter texel on a 16k atlas.
+struct texcoord_unorm16x2
+{
+    enum { Location = ATTRIB_TEXCOORD, Components = 2, Type = GL_UNSIGNED_SHORT, Normalized = GL_TRUE, Size = sizeof(u16) * 2 };
+
+    static void Encode(u8* Dest, const vertex_input& Input)
+    {
+        u16 TexCoord[] = {
+            (u16)(glm::clamp(Input.TexCoord.x, 0.0f, 1.0f) * 65535.0f + 0.5f),
+            (u16)(glm::clamp(Input.TexCoord.y, 0.0f, 1.0f) * 65535.0f + 0.5f)
+        };
+        memcpy(Dest, TexCoord, Size);
+    }
+};
+
+// Four bytes per vertex. GL normalizes them back to 0..1, so the color
+// struct is stored exactly as the caller passed it.
+struct color_unorm8x4
+{
+    enum { Location = ATTRIB_COLOR, Components = 4, Type = GL_UNSIGNED_BYTE, Normalized = GL_TRUE, Size = sizeof(color) };
+
+    template <typename input>
+    static void Encode(u8* Dest, const input& Input)
+    {
+        memcpy(Dest, &Input.Color, Size);
+    }
+};
+
+// Per-instance data of a thick line segment. The miters are the shear of
+// the quad's end edges in half widths; Flags are line_flags.
+struct line_input
+{
+    vec2 Start;
+    vec2 End;
+    f32 HalfWidth;
+    f32 StartMiter;
+    f32 EndMiter;
+    u32 Flags;
+    color Color;
+};
+
+struct line_endpoints_f32x4
+{
+    enum { Location = ATTRIB_ENDPOINTS, Components = 4, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 4 };
+
+    static void Encode(u8* Dest, const line_input& Input)
+    {
+        f32 Endpoints[] = { Input.Start.x, Input.Start.y, Input.End.x, Input.End.y };
+        memcpy(Dest, Endpoints, Size);
+    }
+};
+
+struct line_shape_f32x4
+{
+    enum { Location = ATTRIB_SHAPE, Components = 4, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 4 };
+
+    static void Encode(u8* Dest, const line_input& Input)
+    {
+        f32 Shape[] = { Input.HalfWidth, Input.StartMiter, Input.EndMiter, (f32)Input.Flags };
+        memcpy(Dest, Shape, Size);
+    }
+};
+
+// Per-instance data of an SDF shape: a rounded box around Center.
+struct shape_input
+{
+    vec2 Center;
+    vec2 HalfSize;
+    f32 Radius;
+    f32 Thickness;
+    color Color;
+};
+
+struct shape_bounds_f32x4
+{
+    enum { Location = ATTRIB_BOUNDS, Components = 4, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 4 };
+
+    static void Encode(u8* Dest, const shape_input& Input)
+    {
+        f32 Bounds[] = { Input.Center.x, Input.Center.y, Input.HalfSize.x, Input.HalfSize.y };
+        memcpy(Dest, Bounds, Size);
+    }
+};
+
+struct shape_radii_f32x2
+{
+    enum { Location = ATTRIB_SHAPE, Components = 2, Type = GL_FLOAT, Normalized = GL_FALSE, Size = sizeof(f32) * 2 };
+
+    static void Encode(u8* Dest, const shape_input& Input)
+    {
+        f32 Radii[] = { Input.Radius, Input.Thickness };
+        memcpy(Dest, Radii, Size);
+    }
+};
+
+/*
+================================
+Formats
+================================
+*/
+
+// Offset is where Attribute starts; the recursion ends at the stride.
+template <u32 Offset, typename... Attributes>
+struct vertex_layout
+{
+    enum { Stride = Offset };
+
+    static void Setup(GLsizei, u32) {}
+
+    template <typename input>
+    static void Write(u8*, const input&) {}
+};
+
+template <u32 Offset, typename Attribute, typename... Rest>
+struct vertex_layout<Offset, Attribute, Rest...>
+{
+    typedef vertex_layout<Offset + Attribute::Size, Rest...> next;
+    enum { Stride = next::Stride };
+
+    static void Setup(GLsizei FormatStride, u32 Divisor)
+    {
+        glEnableVertexAttribArray(Attribute::Location);
+        glVertexAttribPointer(Attribute::Location, Attribute::Components, Attribute::Type,
+            Attribute::Normalized, FormatStride, (const void*)(uintptr_t)Offset);
+        glVertexAttribDivisor(Attribute::Location, Divisor);
+        next::Setup(FormatStride, Divisor);
+    }
+
+    template <typename input>
+    static void Write(u8* Vertex, const input& Input)
+    {
+        Attribute::Encode(Vertex + Offset, Input);
+        next::Write(Vertex, Input);
+    }
+};
+
+// Divisor 0 advances per vertex, 1 per instance.
+template <u32 FormatDivisor, typename... Attributes>
+struct attribute_format
+{
+    typedef vertex_layout<0, Attributes...> layout;
+    enum { Stride = layout::Stride, Divisor = FormatDivisor };
+
+    static_assert(Stride % 4 == 0, "attributes must stay 4-byte aligned");
+
+    // Expects the VAO and the vertex buffer to be bound.
+    static void Setup()
+    {
+        layout::Setup(Stride, Divisor);
+    }
+
+    template <typename input>
+    static void Write(u8* Vertex, const input& Input)
+    {
+        layout::Write(Vertex, Input);
+    }
+};
+
+template <typename... Attributes>
+struct vertex_format : attribute_format<0, Attributes...> {};
+
+template <typename... Attributes>
+struct instance_format : attribute_format<1, Attributes...> {};
+
+// Points, lines and plain triangles never sample a texture, so only the
+// textured batch pays for texture coordinates.
+#if RENDER_COMPACT_VERTICES
+typedef vertex_format<position_s16x2, color_unorm8x4> color_vertex;
+typedef vertex_format<position_s16x2, texcoord_unorm16x2, color_unorm8x4> textured_vertex;
+#else
+typedef vertex_format<position_f32x2, color_unorm8x4> color_vertex;
+typedef vertex_format<position_f32x2, texcoord_f32x2, color_unorm8x4> textured_vertex;
+#endif
+
+// One record per segment; the vertex shader expands it into a quad.
+typedef instance_format<line_endpoints_f32x4, line_shape_f32x4, color_unorm8x4> line_instance;
+typedef instance_format<shape_bounds_f32x4, shape_radii_f32x2, color_unorm8x4> shape_instance;
+
+template <s32 Mode> struct batch_format { typedef color_vertex type; };
+template <> struct batch_format<R_TEXTURES> { typedef textured_vertex type; };
+template <> struct batch_format<R_THICK_LINES> { typedef line_instance type; };
+template <> struct batch_format<R_SHAPES> { typedef shape_instance type; };